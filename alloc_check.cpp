@@ -0,0 +1,119 @@
+/*Allocation check of the answer path, run with `make alloc-check`. The server is built in with a counting operator new,
+  a session is driven over a socketpair through START, nickname and theme, and once warmed up every answer (verdict and
+  next question, plain and compressed) must be served without touching the heap*/
+#define main serverMain
+#include "server.cpp"
+#undef main
+
+#include <cstdlib>
+#include <new>
+
+#define ALLOC_CHECK_QUESTIONS 1024
+#define ALLOC_CHECK_WARMUP 16
+#define ALLOC_CHECK_ANSWERS 512
+
+/*Every allocation of the process, the check runs on a single thread*/
+std::atomic<uint64_t> allocations{0};
+
+void *operator new(size_t size) {
+  ++allocations;
+  if (void *pointer = std::malloc(size ? size : 1)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { std::free(pointer); }
+
+/*Function to write one frame as the client would, from a fixed buffer so the client side never allocates*/
+void clientSend(int clientSocket, const char *message) {
+  char frame[BUFFER_SIZE];
+  uint32_t length = std::strlen(message);
+  uint32_t header = htonl(length);
+  std::memcpy(frame, &header, sizeof(header));
+  std::memcpy(frame + sizeof(header), message, length);
+  send(clientSocket, frame, sizeof(header) + length, MSG_NOSIGNAL);
+}
+
+/*Function to read one frame as the client would, returns whether it was compressed*/
+bool clientReceive(int clientSocket) {
+  static char payload[MAX_FRAME_SIZE];
+  uint32_t header = 0;
+  receiveAll(clientSocket, &header, sizeof(header));
+  header = ntohl(header);
+  receiveAll(clientSocket, payload, header & ~FRAME_COMPRESSED_FLAG);
+  return header & FRAME_COMPRESSED_FLAG;
+}
+
+/*Function to play one session and count the allocations of its answers after the warm up, -1 on a broken session*/
+long long checkSession(const char *nickname, bool compressed) {
+  int sockets[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+    return -1;
+  }
+  int clientSocket = sockets[1];
+  AddressLimiter limiter;
+  long long counted = -1;
+  size_t compressedFrames = 0;
+  {
+    Connection connection(sockets[0], "alloc-check", &limiter);
+    ConnectionHandler handler(connection);
+    std::string &message = connection.inBuffer;
+    auto serve = [&](const char *request, int replies) {
+      clientSend(clientSocket, request);
+      bool served = secureReceive(connection, message) && handler.onMessage(message);
+      for (int reply = 0; reply < replies; ++reply) {
+        compressedFrames += clientReceive(clientSocket);
+      }
+      return served;
+    };
+    if ((compressed && !serve("COMPRESS 32768", 1)) || !serve("START", 0) || !serve(nickname, 1) || !serve("1", 2)) {
+      close(clientSocket);
+      return -1;
+    }
+    uint64_t before = 0;
+    for (int answer = 0; answer < ALLOC_CHECK_WARMUP + ALLOC_CHECK_ANSWERS; ++answer) {
+      if (answer == ALLOC_CHECK_WARMUP) {
+        before = allocations;
+      }
+      /*Right and wrong answers in turn, so the rankings move too*/
+      if (!serve(answer % 2 ? "risposta" : "sbagliata", 2)) {
+        close(clientSocket);
+        return -1;
+      }
+    }
+    counted = allocations - before;
+  }
+  close(clientSocket);
+  if (compressed && compressedFrames == 0) {
+    std::cerr << "Nessun frame compresso, il controllo non copre la compressione\n";
+    return -1;
+  }
+  return counted;
+}
+
+int main() {
+  /*A single theme with long questions, longer than COMPRESSION_MIN_SIZE so they go compressed once negotiated*/
+  auto bank = std::make_shared<std::vector<Question>>();
+  for (int index = 0; index < ALLOC_CHECK_QUESTIONS; ++index) {
+    bank->push_back({"Domanda " + std::to_string(index) + ": quale risposta viene accettata da questo controllo delle "
+      "allocazioni, che gira su una sessione vera e guarda solo il percorso delle risposte?", "risposta"});
+  }
+  std::vector<Theme> loaded;
+  loaded.push_back({"Allocazioni", "alloc_check", bank, ANSWER_WINDOW_SECONDS});
+  installThemes(std::move(loaded));
+  messageRate = 0;
+
+  bool passed = true;
+  for (bool compressed : {false, true}) {
+    long long counted = checkSession(compressed ? "alloc_compressed" : "alloc_plain", compressed);
+    std::cout << "Allocazioni in " << ALLOC_CHECK_ANSWERS << " risposte (" << (compressed ? "frame compressi" : "frame semplici")
+      << "): " << counted << "\n";
+    passed = passed && counted == 0;
+  }
+  return passed ? 0 : 1;
+}
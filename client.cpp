@@ -1,15 +1,16 @@
-#include <arpa/inet.h>
 #include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <mutex>
+#include <sstream>
 #include <string>
-#include <sys/time.h>
-#include <unistd.h>
 #include <vector>
 
-/*Max size of buffer*/
-#define BUFFER_SIZE 1024
+#include "client_core.h"
+
+/*Names per ranking page, the server grants more once compressed frames are larger*/
+#define SCOREBOARD_PAGE 10
 
 /*Global variables*/
 std::ofstream logFile("client.log", std::ios::out | std::ios::app);
@@ -40,68 +41,59 @@ void showMenu() {
 /*TriviaClient class*/
 class TriviaClient {
   private:
-    int clientSocket;
+    ClientCore core;
     std::string nickname;
     int theme;
+    /*Names of the themes offered by the server, the id of a theme is its position plus one*/
+    std::vector<std::string> themeNames;
     int port;
-    bool isConnected;
+    unsigned long long scoreboardVersion{0};
+    Transport transport;
+    std::string socketPath;
 
-    /*Function to send messages to the client, first sends the length of the message and then the message itself*/
+    /*Function to send messages to the server, the network thread writes them*/
     bool secureSend(const std::string &message) {
-      uint32_t messageLength = htonl(message.size());
-      if (send(clientSocket, &messageLength, sizeof(messageLength), 0) < 0) {
-        logMessage("Error sending message length: " + std::to_string(errno));
+      if (!core.send(message)) {
+        logMessage("Error sending message: connection closed");
         return false;
       }
-
-      if (send(clientSocket, message.c_str(), message.size(), 0) < 0) {
-        logMessage("Error sending message: " + std::to_string(errno));
-        return false;
-      }
-
-      logMessage("Sent: " + message);
       return true;
     }
 
-    /*Function to receive messages from the client, first receives the length of the message and then the message itself*/
+    /*Function to receive messages from the server, usually already waiting in the inbox of the network thread*/
     bool secureReceive(std::string &message) {
-      uint32_t messageLength = 0;
-      int bytesReceived = recv(clientSocket, &messageLength, sizeof(messageLength), 0);
-      if (bytesReceived <= 0) {
-        logMessage("Error receiving message length");
-        return false;
+      if (core.receive(message)) {
+        return true;
       }
-
-      messageLength = ntohl(messageLength);
-      if (messageLength > BUFFER_SIZE) {
-        logMessage("Message too large: " + std::to_string(messageLength));
-        return false;
-      }
-
-      std::vector<char> buffer(messageLength + 1);
-      bytesReceived = recv(clientSocket, buffer.data(), messageLength, 0);
-      if (bytesReceived <= 0) {
-        logMessage("Error receiving message");
-        return false;
+      if (core.terminated()) {
+        /*The termination message is already on screen, the user only has to confirm*/
+        waitEnter();
       }
+      logMessage("Error receiving message: connection closed");
+      return false;
+    }
 
-      buffer[bytesReceived] = '\0';
-      message = buffer.data();
-      logMessage("Received: " + message);
+    /*Clears screen and display termination message, called by the network thread as soon as it arrives*/
+    void handleServerTermination() {
+      clearScreen();
+      std::cout << "Il server è stato terminato. Il gioco non è più disponibile.\nPremi invio per uscire...";
+      std::cout.flush();
+    }
 
-      if (message == "SERVER_TERMINATED") {
-        handleServerTermination();
+    /*Function to wait for enter, leaving if the server was terminated in the meantime*/
+    void waitEnter() {
+      std::cin.get();
+      if (core.terminated()) {
         exit(0);
-        return false;
       }
-      return true;
     }
 
-    /*Clears screen and display termination message*/
-    void handleServerTermination() {
-      clearScreen();
-      std::cout << "Il server è stato terminato. Il gioco non è più disponibile.\n";
-      std::cin.get();
+    /*Function to read a line typed by the user, leaving if the server was terminated in the meantime*/
+    void readLine(std::string &line) {
+      std::getline(std::cin, line);
+      if (core.terminated()) {
+        exit(0);
+      }
     }
 
     /*Function to set the nickname*/
@@ -112,19 +104,19 @@ class TriviaClient {
           << "+++++++++++++++++++++++++++++\n"
           << "Scegli un nickname (deve essere univoco): ";
 
-        std::getline(std::cin, nickname);
+        readLine(nickname);
 
         if (nickname.empty()) {
           std::cout
             << "Nickname non può essere vuoto. Premi invio per riprovare...";
-          std::cin.get();
+          waitEnter();
           continue;
         }
 
         if (!secureSend(nickname)) {
           std::cout
             << "Errore nell'invio del nickname. Premi invio per riprovare...";
-          std::cin.get();
+          waitEnter();
           continue;
         }
 
@@ -132,7 +124,7 @@ class TriviaClient {
         if (!secureReceive(response)) {
           std::cout << "Errore nella ricezione della risposta. Premi invio per "
             "riprovare...";
-          std::cin.get();
+          waitEnter();
           continue;
         }
 
@@ -140,38 +132,77 @@ class TriviaClient {
           return;
         }
 
+        if (response == "INVALID_NICKNAME") {
+          std::cout << "Nickname non valido (massimo 32 caratteri). Premi invio per riprovare...";
+          waitEnter();
+          continue;
+        }
+
         if (response == "NICKNAME_ALREADY_USED") {
           std::cout << "Nickname già in uso. Premi invio per riprovare...";
-          std::cin.get();
+          waitEnter();
           continue;
         }
       }
     }
 
+    /*Function to ask the server for its themes, answered "THEMES" and one line "<id> <domande> <nome>" each*/
+    bool loadThemes() {
+      std::string reply;
+      if (!secureSend("THEMES") || !secureReceive(reply) || reply.rfind("THEMES\n", 0) != 0) {
+        return false;
+      }
+      themeNames.clear();
+      std::istringstream lines(reply.substr(7));
+      std::string line;
+      while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        int id;
+        size_t questions;
+        std::string name;
+        if (fields >> id >> questions && std::getline(fields >> std::ws, name)) {
+          themeNames.push_back(name);
+        }
+      }
+      return !themeNames.empty();
+    }
+
     /*Function to select the theme*/
     bool selectTheme() {
+      if (!loadThemes()) {
+        std::cout << "Errore nella ricezione dei temi.\nPremi invio per continuare...";
+        waitEnter();
+        return false;
+      }
       while (true) {
         clearScreen();
         std::cout << "Quiz disponibili\n"
-          << "+++++++++++++++++++++++++++++\n"
-          << "1 - Curiosita sulla tecnologia\n"
-          << "2 - Cultura generale\n"
-          << "+++++++++++++++++++++++++++++\n"
+          << "+++++++++++++++++++++++++++++\n";
+        for (size_t id = 1; id <= themeNames.size(); ++id) {
+          std::cout << id << " - " << themeNames[id - 1] << "\n";
+        }
+        std::cout << "+++++++++++++++++++++++++++++\n"
           << "La tua scelta: ";
 
         std::string input;
-        std::getline(std::cin, input);
+        readLine(input);
 
-        if (input != "1" && input != "2") {
+        int selected = 0;
+        try {
+          selected = std::stoi(input);
+        } catch (const std::exception &e) {
+          selected = 0;
+        }
+        if (selected < 1 || static_cast<size_t>(selected) > themeNames.size()) {
           std::cout << "Scelta non valida. Premi invio per riprovare...";
-          std::cin.get();
+          waitEnter();
           continue;
         }
 
         if (!secureSend(input)) {
           std::cout
             << "Errore nell'invio della scelta. Premi invio per riprovare...";
-          std::cin.get();
+          waitEnter();
           continue;
         }
 
@@ -179,33 +210,75 @@ class TriviaClient {
         if (!secureReceive(response)) {
           std::cout << "Errore nella ricezione della risposta. Premi invio per "
             "riprovare...";
-          std::cin.get();
+          waitEnter();
           continue;
         }
 
         if (response == "OK") {
-          theme = std::stoi(input);
+          theme = selected;
           return true;
         }
 
         if (response == "INVALID_THEME") {
           std::cout << "Tema non valido. Premi invio per riprovare...";
-          std::cin.get();
+          waitEnter();
           continue;
         }
 
         if (response == "ALREADY_COMPLETED") {
           std::cout << "Hai già completato questo tema. Scegli un altro tema.\nPremi invio per continuare...";
-          std::cin.get();
+          waitEnter();
           continue;
         }
 
         std::cout << response << "\nPremi invio per continuare...";
-        std::cin.get();
+        waitEnter();
         return false;
       }
     }
 
+    /*Function to translate the scoreboard commands typed by the user into server requests*/
+    std::string scoreboardRequest(const std::string &answer) {
+      std::string pageSize = std::to_string(SCOREBOARD_PAGE * (core.frameLimit() / BUFFER_SIZE));
+      if (answer == "show top") {
+        return "SCOREBOARD TOP " + std::to_string(theme) + " " + pageSize;
+      }
+      if (answer == "show rank") {
+        return "SCOREBOARD PAGE " + std::to_string(theme) + " " + pageSize;
+      }
+      if (answer == "show changes") {
+        return "SCOREBOARD SINCE " + std::to_string(scoreboardVersion);
+      }
+      return answer;
+    }
+
+    /*Function to display a scoreboard reply, the first line carries the version used for "show changes"*/
+    void showScoreboard(const std::string &scoreboard) {
+      std::string body = scoreboard;
+      if (scoreboard.rfind("SCOREBOARD ", 0) == 0) {
+        size_t lineEnd = scoreboard.find('\n');
+        try {
+          scoreboardVersion = std::stoull(scoreboard.substr(11, lineEnd - 11));
+        } catch (const std::exception &e) {
+          logMessage("Invalid scoreboard version: " + scoreboard.substr(0, lineEnd));
+        }
+        body = (lineEnd == std::string::npos) ? "" : scoreboard.substr(lineEnd + 1);
+      }
+      clearScreen();
+      std::cout << (body.empty() ? "Nessuna novita.\n" : body) << "\nPremi invio per continuare...";
+      waitEnter();
+    }
+
+    /*Function to show the verdict of an answer*/
+    void showVerdict(const std::string &verdict) {
+      clearScreen();
+      std::cout << "\n********************************\n"
+        << "\t" << (verdict == "TIMEOUT" ? "Tempo scaduto!" : verdict) << "\n"
+        << "********************************\n"
+        << "Premi invio per continuare...";
+      waitEnter();
+    }
+
     /*Function to play the quiz*/
     void playQuiz() {
       while (true) {
@@ -223,50 +296,59 @@ class TriviaClient {
           continue;
         }
 
-        /*what to do if both quizez are completed*/
+        /*The answer window expired while the user was thinking, the server already moved to the next question*/
+        if (question == "TIMEOUT") {
+          showVerdict(question);
+          continue;
+        }
+
+        /*what to do if every quiz is completed*/
         if (question == "BOTH_QUIZZES_COMPLETED") {
           clearScreen();
           std::cout 
             << "*******************************************\n"
-            << "\tHai completato entrambi i quiz!\n"
+            << "\tHai completato tutti i quiz!\n"
             << "*******************************************\n"
             << "Premi invio per eliminare i dati e uscire...";
-          std::cin.get();
+          waitEnter();
           if (!secureSend("CLIENT_FINISHED")) {
             std::cout << "Errore nell'invio del messaggio di conferma.\n";
           }
-          /*break;*/
+          /*The network thread sends CLIENT_FINISHED before closing*/
+          core.disconnect();
           exit(EXIT_SUCCESS);
         }
 
         /*Format for questions and answers*/
         clearScreen();
-        std::string themeStr =
-          (theme == 1) ? "Curiosita sulla tecnologia" : "Cultura generale";
-        std::cout << "\nQuiz - " << themeStr << "\n"
+        std::cout << "\nQuiz - " << themeNames[theme - 1] << "\n"
           << "********************************\n"
           << question << "\n"
           << "********************************\n"
-          << "Risposta (o 'show score'/'endquiz'): ";
+          << "Risposta (o 'show score'/'show top'/'show rank'/'show changes'/'endquiz'): ";
 
         std::string answer;
-        std::getline(std::cin, answer);
+        readLine(answer);
+
+        /*A frame arrived while typing: the window expired and the answer would count for the next question*/
+        if (core.ready()) {
+          logMessage("Answer window expired while typing, answer dropped");
+          continue;
+        }
 
         /*Special case for show score and endquiz*/
-        if (!secureSend(answer)) {
+        if (!secureSend(scoreboardRequest(answer))) {
           std::cout << "Errore nell'invio della risposta.\n";
           return;
         }
 
-        if (answer == "show score") {
+        if (answer == "show score" || answer == "show top" || answer == "show rank" || answer == "show changes") {
           std::string scoreboard;
           if (!secureReceive(scoreboard)) {
             std::cout << "Errore nella ricezione del punteggio.\n";
             return;
           }
-          clearScreen();
-          std::cout << scoreboard << "\nPremi invio per continuare...";
-          std::cin.get();
+          showScoreboard(scoreboard);
           continue;
         }
 
@@ -277,7 +359,7 @@ class TriviaClient {
             return;
           }
           std::cout << endMessage << "\nPremi invio per continuare...";
-          std::cin.get();
+          waitEnter();
           break;
         }
 
@@ -288,40 +370,19 @@ class TriviaClient {
           return;
         }
 
-        clearScreen();
-        std::cout << "\n********************************\n"
-          << "\t" << result << "\n"
-          << "********************************\n"
-          << "Premi invio per continuare...";
-        std::cin.get();
+        showVerdict(result);
+        /*The server sends the next question right after the verdict, the network thread received it while the user was reading*/
+        if (core.ready()) {
+          logMessage("Next question prefetched");
+        }
       }
     }
 
   public:
-    TriviaClient(int serverPort) : port(serverPort), isConnected(false) {}
-
-    /*Function to connect to the server*/
-    bool connectToServer() {
-      struct sockaddr_in serverAddr;
-
-      clientSocket = socket(AF_INET, SOCK_STREAM, 0);
-      if (clientSocket < 0) {
-        logMessage("Creazione socket fallita");
-        return false;
-      }
-
-      serverAddr.sin_family = AF_INET;
-      serverAddr.sin_port = htons(port);
-      serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
-
-      if (connect(clientSocket, (struct sockaddr *)&serverAddr,
-            sizeof(serverAddr)) < 0) {
-        logMessage("Connessione fallita");
-        return false;
-      }
-
-      isConnected = true;
-      return true;
+    TriviaClient(int serverPort, Transport clientTransport, const std::string &path)
+      : port(serverPort), transport(clientTransport), socketPath(path) {
+      core.logHandler = logMessage;
+      core.pushHandler = [this](const std::string &) { handleServerTermination(); };
     }
 
     /*Main function to start the client*/
@@ -329,21 +390,25 @@ class TriviaClient {
       std::string input;
       while (true) {
         showMenu();
-        std::getline(std::cin, input);
+        readLine(input);
 
         /*Main logic of the client*/
         if (input == "1") {
-          if (!isConnected && !connectToServer()) {
-            std::cout << "Impossibile connettersi al server.\nPremi invio per "
-              "continuare...";
-            std::cin.get();
-            continue;
+          if (!core.connected()) {
+            if (!core.connect(transport, port, socketPath)) {
+              std::cout << "Impossibile connettersi al server.\nPremi invio per "
+                "continuare...";
+              waitEnter();
+              continue;
+            }
+            /*Longer rankings when the server agrees, plain frames otherwise*/
+            core.negotiateCompression(MAX_FRAME_SIZE);
           }
 
           if (!secureSend("START")) {
             std::cout
               << "Errore nell'avvio del gioco.\nPremi invio per continuare...";
-            std::cin.get();
+            waitEnter();
             continue;
           }
 
@@ -356,22 +421,20 @@ class TriviaClient {
           break;
         } else {
           std::cout << "Scelta non valida.\nPremi invio per continuare...";
-          std::cin.get();
+          waitEnter();
         }
       }
 
       /*Close when finished*/
-      if (isConnected) {
-        close(clientSocket);
-      }
+      core.disconnect();
     }
 };
 
 /*main waiting for argument of port*/
 int main(int argc, char *argv[]) {
   logMessage("------------------------------ CLIENT START -----------------------------\n");
-  if (argc != 2) {
-    std::cerr << "Uso: " << argv[0] << " <porta>\n";
+  if (argc < 2 || argc > 4) {
+    std::cerr << "Uso: " << argv[0] << " <porta> [tcp|unix|shm [percorso socket]]\n";
     return 1;
   }
 
@@ -381,8 +444,23 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  /*Clients on the same host can use the Unix socket of the server, or shared memory negotiated over it*/
+  std::string transportName = (argc > 2) ? argv[2] : "tcp";
+  Transport transport;
+  if (transportName == "tcp") {
+    transport = TRANSPORT_TCP;
+  } else if (transportName == "unix") {
+    transport = TRANSPORT_UNIX;
+  } else if (transportName == "shm") {
+    transport = TRANSPORT_SHM;
+  } else {
+    std::cerr << "Trasporto non valido: " << transportName << "\n";
+    return 1;
+  }
+  std::string socketPath = (argc > 3) ? argv[3] : UNIX_SOCKET_PATH;
+
   /*START*/
-  TriviaClient client(port);
+  TriviaClient client(port, transport, socketPath);
   client.start();
 
   return 0;
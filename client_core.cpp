@@ -0,0 +1,405 @@
+#include "client_core.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+bool ClientCore::connect(Transport transport, int port, const std::string &path) {
+  disconnect();
+  if (transport == TRANSPORT_TCP) {
+    struct sockaddr_in serverAddr{};
+
+    clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (clientSocket < 0) {
+      log("Creazione socket fallita");
+      return false;
+    }
+
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(port);
+    serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    /*Frames are small and each one waits for a reply, so they are not held back*/
+    int noDelay = 1;
+    setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    if (::connect(clientSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) {
+      log("Connessione fallita");
+      close(clientSocket);
+      clientSocket = -1;
+      return false;
+    }
+  } else {
+    struct sockaddr_un serverAddr{};
+
+    clientSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (clientSocket < 0) {
+      log("Creazione socket fallita");
+      return false;
+    }
+
+    serverAddr.sun_family = AF_UNIX;
+    std::strncpy(serverAddr.sun_path, path.c_str(), sizeof(serverAddr.sun_path) - 1);
+
+    if (::connect(clientSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0 ||
+        (transport == TRANSPORT_SHM && !openSharedChannel())) {
+      log("Connessione fallita");
+      close(clientSocket);
+      clientSocket = -1;
+      return false;
+    }
+  }
+
+  wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  {
+    std::lock_guard<std::mutex> lock(outboxMutex);
+    dictionary.clear();
+    compressed = false;
+  }
+  maxFrame = BUFFER_SIZE;
+  stopping = false;
+  serverTerminated = false;
+  closed = false;
+  output.clear();
+  outputSent = 0;
+  input.clear();
+  networkThread = std::thread(&ClientCore::run, this);
+  return true;
+}
+
+void ClientCore::disconnect() {
+  if (networkThread.joinable()) {
+    stopping = true;
+    uint64_t one = 1;
+    write(wakeFd, &one, sizeof(one));
+    networkThread.join();
+  }
+  if (channel != nullptr) {
+    munmap(channel, sizeof(SharedChannel));
+    channel = nullptr;
+  }
+  if (clientSocket >= 0) {
+    close(clientSocket);
+    clientSocket = -1;
+  }
+  if (wakeFd >= 0) {
+    close(wakeFd);
+    wakeFd = -1;
+  }
+  std::lock_guard<std::mutex> outboxLock(outboxMutex);
+  outbox.clear();
+  std::lock_guard<std::mutex> inboxLock(inboxMutex);
+  inbox.clear();
+  closed = true;
+}
+
+bool ClientCore::send(const std::string &message) {
+  if (closed) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(outboxMutex);
+    thread_local std::string packed;
+    if (compressed && message.size() >= COMPRESSION_MIN_SIZE && compressFrame(message, dictionary, packed)) {
+      uint32_t messageLength = htonl(packed.size() | FRAME_COMPRESSED_FLAG);
+      outbox.append(reinterpret_cast<const char *>(&messageLength), sizeof(messageLength));
+      outbox += packed;
+    } else {
+      uint32_t messageLength = htonl(message.size());
+      outbox.append(reinterpret_cast<const char *>(&messageLength), sizeof(messageLength));
+      outbox += message;
+    }
+  }
+  uint64_t one = 1;
+  write(wakeFd, &one, sizeof(one));
+  log("Sent: " + message);
+  return true;
+}
+
+bool ClientCore::receive(std::string &message, int timeoutMs) {
+  std::unique_lock<std::mutex> lock(inboxMutex);
+  auto available = [this] { return !inbox.empty() || closed || serverTerminated; };
+  if (timeoutMs < 0) {
+    inboxReady.wait(lock, available);
+  } else if (!inboxReady.wait_for(lock, std::chrono::milliseconds(timeoutMs), available)) {
+    return false;
+  }
+  if (inbox.empty() || serverTerminated) {
+    return false;
+  }
+  message = std::move(inbox.front());
+  inbox.pop_front();
+  return true;
+}
+
+bool ClientCore::ready() {
+  std::lock_guard<std::mutex> lock(inboxMutex);
+  return !inbox.empty();
+}
+
+bool ClientCore::negotiateCompression(size_t requested) {
+  std::string reply;
+  if (!send("COMPRESS " + std::to_string(requested)) || !receive(reply) || reply.rfind("COMPRESS_READY ", 0) != 0) {
+    log("Compressione rifiutata dal server");
+    return false;
+  }
+  return true;
+}
+
+/*Function to ask the server for the shared memory rings, it answers SHM_READY with the memfd attached*/
+bool ClientCore::openSharedChannel() {
+  std::string frame(sizeof(uint32_t), '\0');
+  uint32_t messageLength = htonl(3);
+  std::memcpy(frame.data(), &messageLength, sizeof(messageLength));
+  frame += "SHM";
+  if (::send(clientSocket, frame.data(), frame.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(frame.size())) {
+    return false;
+  }
+  log("Sent: SHM");
+  char reply[sizeof(uint32_t) + 16];
+  iovec payload{reply, sizeof(reply)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+  msghdr header{};
+  header.msg_iov = &payload;
+  header.msg_iovlen = 1;
+  header.msg_control = control;
+  header.msg_controllen = sizeof(control);
+  ssize_t received = recvmsg(clientSocket, &header, MSG_CMSG_CLOEXEC);
+  cmsghdr *rights = CMSG_FIRSTHDR(&header);
+  std::string text = (received > static_cast<ssize_t>(sizeof(uint32_t)))
+    ? std::string(reply + sizeof(uint32_t), received - sizeof(uint32_t)) : "";
+  if (text != "SHM_READY" || rights == nullptr || rights->cmsg_type != SCM_RIGHTS) {
+    log("Memoria condivisa rifiutata dal server");
+    return false;
+  }
+  int memory;
+  std::memcpy(&memory, CMSG_DATA(rights), sizeof(memory));
+  void *region = mmap(nullptr, sizeof(SharedChannel), PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+  close(memory);
+  if (region == MAP_FAILED) {
+    log("Mappatura della memoria condivisa fallita");
+    return false;
+  }
+  channel = static_cast<SharedChannel *>(region);
+  log("Received: SHM_READY");
+  return true;
+}
+
+/*Function to wake the server if it sleeps on the rings*/
+void ClientCore::ringDoorbell() {
+  if (channel->serverWaiting.exchange(0) != 0) {
+    char bell = 0;
+    ::send(clientSocket, &bell, sizeof(bell), MSG_DONTWAIT | MSG_NOSIGNAL);
+  }
+}
+
+/*Function to discard the doorbell bytes, false once the server closed the socket*/
+bool ClientCore::drainDoorbell() {
+  char bells[64];
+  while (true) {
+    ssize_t bytes = recv(clientSocket, bells, sizeof(bells), MSG_DONTWAIT);
+    if (bytes > 0 || (bytes < 0 && errno == EINTR)) {
+      continue;
+    }
+    return bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+}
+
+/*Function to write what the socket or the ring accepts without blocking, false on a broken connection*/
+bool ClientCore::flushOutput(bool &progress) {
+  while (outputSent < output.size()) {
+    ssize_t written;
+    if (channel == nullptr) {
+      written = ::send(clientSocket, output.data() + outputSent, output.size() - outputSent, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          break;
+        }
+        log("Error sending message: " + std::to_string(errno));
+        return false;
+      }
+    } else {
+      written = channel->toServer.write(output.data() + outputSent, output.size() - outputSent);
+      if (written == 0) {
+        break;
+      }
+      ringDoorbell();
+    }
+    outputSent += written;
+    progress = true;
+  }
+  if (outputSent == output.size()) {
+    output.clear();
+    outputSent = 0;
+  }
+  return true;
+}
+
+/*Function to read what is available on the socket or the ring, false once the server closed the socket*/
+bool ClientCore::fillInput(bool &progress) {
+  char buffer[BUFFER_SIZE * 4];
+  while (true) {
+    ssize_t received;
+    if (channel == nullptr) {
+      received = recv(clientSocket, buffer, sizeof(buffer), MSG_DONTWAIT);
+      if (received == 0) {
+        return false;
+      }
+      if (received < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+    } else {
+      received = channel->toClient.read(buffer, sizeof(buffer));
+      if (received == 0) {
+        return true;
+      }
+      ringDoorbell();
+    }
+    input.append(buffer, received);
+    progress = true;
+  }
+}
+
+/*Function to move the complete frames to the inbox, false on a frame larger than the protocol allows*/
+bool ClientCore::parseInput() {
+  size_t offset = 0;
+  bool queued = false;
+  while (input.size() - offset >= sizeof(uint32_t)) {
+    uint32_t messageLength;
+    std::memcpy(&messageLength, input.data() + offset, sizeof(messageLength));
+    messageLength = ntohl(messageLength);
+    bool packed = messageLength & FRAME_COMPRESSED_FLAG;
+    messageLength &= ~FRAME_COMPRESSED_FLAG;
+    if (messageLength > maxFrame) {
+      log("Message too large: " + std::to_string(messageLength));
+      return false;
+    }
+    if (input.size() - offset - sizeof(uint32_t) < messageLength) {
+      break;
+    }
+    std::string message;
+    std::string_view payload(input.data() + offset + sizeof(uint32_t), messageLength);
+    /*The dictionary is only written by this thread, reading it without the lock is safe here*/
+    if (!packed) {
+      message.assign(payload);
+    } else if (!compressed || !decompressFrame(payload, dictionary, maxFrame, message)) {
+      log("Malformed compressed frame");
+      return false;
+    }
+    offset += sizeof(uint32_t) + messageLength;
+
+    /*The frames after this one may be compressed, so the dictionary is taken before parsing them*/
+    if (message.rfind("COMPRESS_READY ", 0) == 0) {
+      size_t lineEnd = message.find('\n');
+      log("Received: " + message.substr(0, lineEnd));
+      if (lineEnd != std::string::npos) {
+        std::lock_guard<std::mutex> lock(outboxMutex);
+        dictionary = message.substr(lineEnd + 1);
+        compressed = true;
+        maxFrame = std::clamp<size_t>(std::strtoul(message.c_str() + sizeof("COMPRESS_READY"), nullptr, 10),
+                                      BUFFER_SIZE, MAX_FRAME_SIZE);
+      }
+    } else {
+      log("Received: " + message);
+    }
+
+    /*Pushed by the server at any moment, it is handled here instead of waiting for the caller to ask*/
+    if (message == "SERVER_TERMINATED") {
+      {
+        std::lock_guard<std::mutex> lock(inboxMutex);
+        serverTerminated = true;
+      }
+      inboxReady.notify_all();
+      if (pushHandler) {
+        pushHandler(message);
+      }
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(inboxMutex);
+    inbox.push_back(std::move(message));
+    queued = true;
+  }
+  input.erase(0, offset);
+  if (queued) {
+    inboxReady.notify_all();
+  }
+  return true;
+}
+
+/*Network thread: moves the queued frames out, the received frames in, and sleeps in poll when neither can advance*/
+void ClientCore::run() {
+  bool peerOpen = true;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(outboxMutex);
+      output += outbox;
+      outbox.clear();
+    }
+    /*On disconnect the frames already queued go out first, CLIENT_FINISHED is usually the last one*/
+    if (stopping && output.empty()) {
+      break;
+    }
+    bool progress = false;
+    if (!flushOutput(progress)) {
+      break;
+    }
+    if (!fillInput(progress)) {
+      peerOpen = false;
+    }
+    if (!parseInput()) {
+      break;
+    }
+    /*With shared memory the last frames are still in the ring when the server closes, they are read first*/
+    if (!peerOpen && (channel == nullptr || channel->toClient.empty())) {
+      break;
+    }
+    if (progress) {
+      continue;
+    }
+
+    if (channel != nullptr) {
+      /*Ask for a doorbell and look at the rings again before sleeping*/
+      channel->clientWaiting = 1;
+      if (!channel->toClient.empty() || (!output.empty() && !channel->toServer.full())) {
+        channel->clientWaiting = 0;
+        continue;
+      }
+    }
+    pollfd fds[2] = {{clientSocket, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+    if (channel == nullptr && !output.empty()) {
+      fds[0].events |= POLLOUT;
+    }
+    if (poll(fds, 2, stopping ? DISCONNECT_FLUSH_MS : -1) == 0) {
+      log("Frames not sent before disconnecting: " + std::to_string(output.size()) + " bytes");
+      break;
+    }
+    if (fds[1].revents & POLLIN) {
+      uint64_t count;
+      read(wakeFd, &count, sizeof(count));
+    }
+    if (channel != nullptr) {
+      channel->clientWaiting = 0;
+      if ((fds[0].revents & (POLLIN | POLLHUP | POLLERR)) && !drainDoorbell()) {
+        peerOpen = false;
+      }
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(inboxMutex);
+    closed = true;
+  }
+  inboxReady.notify_all();
+}
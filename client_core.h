@@ -0,0 +1,103 @@
+#ifndef CLIENT_CORE_H
+#define CLIENT_CORE_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "frame_codec.h"
+#include "shared_channel.h"
+
+/*Max size of buffer*/
+#define BUFFER_SIZE 1024
+#define UNIX_SOCKET_PATH "trivia.sock"
+#define DISCONNECT_FLUSH_MS 1000
+
+/*How the client reaches the server*/
+enum Transport { TRANSPORT_TCP, TRANSPORT_UNIX, TRANSPORT_SHM };
+
+/*Network side of a client: a thread owns the socket (or the shared rings), queues the frames to send and
+  collects the received ones, so the caller never blocks on the network while the user is reading.
+  Used by the interactive client and by the replay load generator*/
+class ClientCore {
+  public:
+    /*Called from the network thread for every line of the log*/
+    std::function<void(const std::string &)> logHandler;
+    /*Called from the network thread as soon as the server pushes SERVER_TERMINATED, the frame is not queued*/
+    std::function<void(const std::string &)> pushHandler;
+
+    ClientCore() = default;
+    ClientCore(const ClientCore &) = delete;
+    ClientCore &operator=(const ClientCore &) = delete;
+    ~ClientCore() { disconnect(); }
+
+    /*Function to connect and start the network thread, the path is used by unix and shm*/
+    bool connect(Transport transport, int port, const std::string &path = UNIX_SOCKET_PATH);
+    /*Function to stop the network thread and close the connection, queued frames get DISCONNECT_FLUSH_MS to go out*/
+    void disconnect();
+
+    /*Function to queue a frame for the network thread, false once the connection is closed*/
+    bool send(const std::string &message);
+    /*Function to take the next received frame, waiting at most timeoutMs (forever when negative),
+      false on timeout, after SERVER_TERMINATED or when the connection is closed and nothing is left*/
+    bool receive(std::string &message, int timeoutMs = -1);
+    /*Function to tell whether a received frame is already waiting, for example a prefetched question*/
+    bool ready();
+    /*Function to ask for compressed frames up to maxFrame bytes, right after connect and before MUX or START.
+      False when the server refused, the connection then keeps plain BUFFER_SIZE frames*/
+    bool negotiateCompression(size_t maxFrame);
+
+    bool connected() const { return !closed; }
+    bool terminated() const { return serverTerminated; }
+    /*Largest frame in both directions, above BUFFER_SIZE only after COMPRESS_READY*/
+    size_t frameLimit() const { return maxFrame; }
+
+  private:
+    int clientSocket{-1};
+    int wakeFd{-1};
+    SharedChannel *channel{nullptr};
+    std::thread networkThread;
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> closed{true};
+    std::atomic<bool> serverTerminated{false};
+    std::atomic<size_t> maxFrame{BUFFER_SIZE};
+
+    /*Frames waiting for the network thread, already with their length (and compressed once negotiated)*/
+    std::mutex outboxMutex;
+    std::string outbox;
+    /*Dictionary received in COMPRESS_READY, written by the network thread under outboxMutex*/
+    std::string dictionary;
+    bool compressed{false};
+    /*Frames received and not yet taken by the caller*/
+    std::mutex inboxMutex;
+    std::condition_variable inboxReady;
+    std::deque<std::string> inbox;
+
+    /*Owned by the network thread*/
+    std::string output;
+    size_t outputSent{0};
+    std::string input;
+
+    void log(const std::string &message) {
+      if (logHandler) {
+        logHandler(message);
+      }
+    }
+
+    bool openSharedChannel();
+    void run();
+    bool flushOutput(bool &progress);
+    bool fillInput(bool &progress);
+    bool parseInput();
+    bool drainDoorbell();
+    void ringDoorbell();
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "frame_codec.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*Limits of the LZ4 block format: matches are at least 4 bytes, the last 5 bytes are always literals and
+  the last match starts at least 12 bytes before the end*/
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_FIND_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 12
+
+static uint32_t read32(const char *data) {
+  uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static uint32_t hash32(uint32_t value) {
+  return (value * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+/*Function to write a length above 15 as a run of 255 bytes and a remainder*/
+static void appendLength(std::string &out, size_t length) {
+  while (length >= 255) {
+    out += static_cast<char>(255);
+    length -= 255;
+  }
+  out += static_cast<char>(length);
+}
+
+static void appendSequence(std::string &out, const char *literals, size_t literalLength, size_t offset, size_t matchLength) {
+  size_t matchCode = (matchLength >= LZ4_MIN_MATCH) ? matchLength - LZ4_MIN_MATCH : 0;
+  out += static_cast<char>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15));
+  if (literalLength >= 15) {
+    appendLength(out, literalLength - 15);
+  }
+  out.append(literals, literalLength);
+  if (matchLength == 0) {
+    return;
+  }
+  out += static_cast<char>(offset & 0xff);
+  out += static_cast<char>(offset >> 8);
+  if (matchCode >= 15) {
+    appendLength(out, matchCode - 15);
+  }
+}
+
+bool compressFrame(std::string_view message, std::string_view dictionary, std::string &payload) {
+  /*The dictionary and the message form one window, so a match can start in the dictionary*/
+  thread_local std::string window;
+  thread_local std::vector<uint32_t> table;
+  window.assign(dictionary);
+  window.append(message);
+  table.assign(1 << LZ4_HASH_BITS, UINT32_MAX);
+  const char *base = window.data();
+  size_t start = dictionary.size();
+  size_t end = window.size();
+  for (size_t position = 0; position + sizeof(uint32_t) <= start; ++position) {
+    table[hash32(read32(base + position))] = position;
+  }
+
+  uint32_t rawSize = htonl(message.size());
+  payload.assign(reinterpret_cast<const char *>(&rawSize), sizeof(rawSize));
+  size_t anchor = start;
+  if (message.size() > LZ4_MATCH_FIND_LIMIT) {
+    size_t matchStartLimit = end - LZ4_MATCH_FIND_LIMIT;
+    size_t matchEndLimit = end - LZ4_LAST_LITERALS;
+    size_t position = start;
+    while (position < matchStartLimit) {
+      uint32_t sequence = read32(base + position);
+      uint32_t &slot = table[hash32(sequence)];
+      size_t candidate = slot;
+      slot = position;
+      if (candidate == UINT32_MAX || position - candidate > LZ4_MAX_OFFSET || read32(base + candidate) != sequence) {
+        ++position;
+        continue;
+      }
+      size_t length = LZ4_MIN_MATCH;
+      while (position + length < matchEndLimit && base[candidate + length] == base[position + length]) {
+        ++length;
+      }
+      appendSequence(payload, base + anchor, position - anchor, position - candidate, length);
+      position += length;
+      anchor = position;
+      if (payload.size() >= message.size()) {
+        return false;
+      }
+    }
+  }
+  appendSequence(payload, base + anchor, end - anchor, 0, 0);
+  return payload.size() < message.size();
+}
+
+/*Function to read a length continued by 255 bytes, false when the block ends in the middle*/
+static bool readLength(std::string_view block, size_t &position, size_t &length) {
+  uint8_t byte;
+  do {
+    if (position >= block.size()) {
+      return false;
+    }
+    byte = block[position++];
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+bool decompressFrame(std::string_view payload, std::string_view dictionary, size_t limit, std::string &message) {
+  if (payload.size() < sizeof(uint32_t)) {
+    return false;
+  }
+  uint32_t rawSize;
+  std::memcpy(&rawSize, payload.data(), sizeof(rawSize));
+  rawSize = ntohl(rawSize);
+  if (rawSize > limit) {
+    return false;
+  }
+  std::string_view block = payload.substr(sizeof(uint32_t));
+  thread_local std::string window;
+  window.assign(dictionary);
+  window.reserve(dictionary.size() + rawSize);
+  size_t maximum = dictionary.size() + rawSize;
+  size_t position = 0;
+  while (position < block.size()) {
+    uint8_t token = block[position++];
+    size_t literalLength = token >> 4;
+    if (literalLength == 15 && !readLength(block, position, literalLength)) {
+      return false;
+    }
+    if (literalLength > block.size() - position || literalLength > maximum - window.size()) {
+      return false;
+    }
+    window.append(block.data() + position, literalLength);
+    position += literalLength;
+    /*The last sequence has literals only*/
+    if (position == block.size()) {
+      break;
+    }
+    if (block.size() - position < 2) {
+      return false;
+    }
+    size_t offset = static_cast<uint8_t>(block[position]) | (static_cast<uint8_t>(block[position + 1]) << 8);
+    position += 2;
+    size_t matchLength = token & 15;
+    if (matchLength == 15 && !readLength(block, position, matchLength)) {
+      return false;
+    }
+    matchLength += LZ4_MIN_MATCH;
+    if (offset == 0 || offset > window.size() || matchLength > maximum - window.size()) {
+      return false;
+    }
+    /*Byte by byte because a match may overlap the bytes it produces, the capacity is reserved so nothing moves*/
+    for (size_t source = window.size() - offset; matchLength > 0; --matchLength, ++source) {
+      char byte = window[source];
+      window.push_back(byte);
+    }
+  }
+  if (window.size() != maximum) {
+    return false;
+  }
+  message.assign(window, dictionary.size());
+  return true;
+}
@@ -0,0 +1,23 @@
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include <string>
+#include <string_view>
+
+/*Top bit of the length header: the payload is compressed, the other 31 bits are its size on the wire*/
+#define FRAME_COMPRESSED_FLAG 0x80000000u
+/*Shorter messages are always sent as they are*/
+#define COMPRESSION_MIN_SIZE 128
+/*Largest frame a connection can negotiate with COMPRESS, compressed or not*/
+#define MAX_FRAME_SIZE (1 << 15)
+
+/*LZ4 block format with an external dictionary: matches may point back into the dictionary as if it preceded the message.
+  A compressed payload is the size of the original message (u32 big endian) followed by the block*/
+
+/*Function to compress a message, false when the result would not be smaller (the message is then sent as it is)*/
+bool compressFrame(std::string_view message, std::string_view dictionary, std::string &payload);
+
+/*Function to restore a message, false on a malformed payload or when the message would exceed `limit`*/
+bool decompressFrame(std::string_view payload, std::string_view dictionary, size_t limit, std::string &message);
+
+#endif
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "client_core.h"
+
+#define CAPTURE_MAGIC "TQCAP001"
+#define RECEIVE_TIMEOUT_SECONDS 10
+
+/*Kind of record stored in a capture file, same values as the server recorder*/
+enum CaptureRecord : uint8_t { CAPTURE_OPEN = 1, CAPTURE_INBOUND, CAPTURE_OUTBOUND, CAPTURE_CLOSE };
+
+/*Single record of the capture*/
+struct Record {
+  CaptureRecord type;
+  uint64_t timestamp;
+  uint32_t length;
+  std::string payload;
+};
+
+/*Results shared by all the replayed sessions*/
+std::mutex resultsMutex;
+std::vector<uint64_t> latencies;
+std::atomic<uint64_t> framesSent{0};
+std::atomic<uint64_t> framesReceived{0};
+std::atomic<uint64_t> failedSessions{0};
+
+/*Function to read the capture file, records are grouped by session keeping their order.
+  Timestamps count from when the server opened the capture, they are rebased on the first record so idle time before
+  the first client is not replayed*/
+bool loadCapture(const std::string &path, std::map<uint32_t, std::vector<Record>> &sessions) {
+  std::ifstream file(path, std::ios::binary);
+  char magic[8];
+  if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0) {
+    return false;
+  }
+  uint64_t first = UINT64_MAX;
+  while (true) {
+    Record record;
+    uint32_t sessionId = 0;
+    if (!file.read(reinterpret_cast<char *>(&record.type), sizeof(record.type))) {
+      break;
+    }
+    file.read(reinterpret_cast<char *>(&sessionId), sizeof(sessionId));
+    file.read(reinterpret_cast<char *>(&record.timestamp), sizeof(record.timestamp));
+    file.read(reinterpret_cast<char *>(&record.length), sizeof(record.length));
+    if (record.type == CAPTURE_INBOUND) {
+      record.payload.resize(record.length);
+      file.read(record.payload.data(), record.length);
+    }
+    if (!file) {
+      /*Truncated tail, for example a server killed while recording*/
+      break;
+    }
+    first = std::min(first, record.timestamp);
+    sessions[sessionId].push_back(std::move(record));
+  }
+  for (auto &session : sessions) {
+    for (Record &record : session.second) {
+      record.timestamp -= first;
+    }
+  }
+  return true;
+}
+
+/*Function to replay one session: connect, send its inbound frames and wait for as many replies as the server sent,
+  the network side is the same core used by the interactive client*/
+void replaySession(const std::vector<Record> &records, int port, bool originalTiming,
+    std::chrono::steady_clock::time_point start) {
+  ClientCore core;
+  bool waitingReply = false;
+  std::chrono::steady_clock::time_point sentAt;
+  std::vector<uint64_t> sessionLatencies;
+  std::string buffer;
+  for (const Record &record : records) {
+    if (originalTiming && record.type != CAPTURE_OUTBOUND) {
+      std::this_thread::sleep_until(start + std::chrono::nanoseconds(record.timestamp));
+    }
+    if (record.type == CAPTURE_OPEN) {
+      if (!core.connect(TRANSPORT_TCP, port)) {
+        ++failedSessions;
+        return;
+      }
+    } else if (record.type == CAPTURE_INBOUND) {
+      /*Shared memory negotiation of a local client, its reply is not a recorded frame and the replay always uses TCP*/
+      if (record.payload == "SHM") {
+        continue;
+      }
+      /*Taken before queueing, the network thread may get the reply before this thread runs again*/
+      sentAt = std::chrono::steady_clock::now();
+      if (!core.send(record.payload)) {
+        ++failedSessions;
+        break;
+      }
+      ++framesSent;
+      waitingReply = true;
+    } else if (record.type == CAPTURE_OUTBOUND) {
+      if (!core.receive(buffer, RECEIVE_TIMEOUT_SECONDS * 1000)) {
+        ++failedSessions;
+        break;
+      }
+      ++framesReceived;
+      /*Latency is measured up to the first reply of each request*/
+      if (waitingReply) {
+        sessionLatencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - sentAt).count());
+        waitingReply = false;
+      }
+    } else if (record.type == CAPTURE_CLOSE) {
+      break;
+    }
+  }
+  core.disconnect();
+  std::lock_guard<std::mutex> lock(resultsMutex);
+  latencies.insert(latencies.end(), sessionLatencies.begin(), sessionLatencies.end());
+}
+
+/*Function to read a percentile from the sorted latencies*/
+uint64_t percentile(double fraction) {
+  if (latencies.empty()) {
+    return 0;
+  }
+  return latencies[std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()))];
+}
+
+/*main waiting for the capture, the port of a fresh server and optionally --fast*/
+int main(int argc, char *argv[]) {
+  if (argc < 3 || argc > 4 || (argc == 4 && std::string(argv[3]) != "--fast")) {
+    std::cerr << "Uso: " << argv[0] << " <cattura> <porta> [--fast]\n";
+    return 1;
+  }
+  int port = std::atoi(argv[2]);
+  if (port <= 0 || port > 65535) {
+    std::cerr << "Numero di porta non valido\n";
+    return 1;
+  }
+  bool originalTiming = argc != 4;
+
+  std::map<uint32_t, std::vector<Record>> sessions;
+  if (!loadCapture(argv[1], sessions)) {
+    std::cerr << "File di cattura non valido: " << argv[1] << "\n";
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (const auto &session : sessions) {
+    threads.emplace_back(replaySession, std::cref(session.second), port, originalTiming, start);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::sort(latencies.begin(), latencies.end());
+  std::cout << "Sessioni: " << sessions.size() << " (fallite: " << failedSessions << ")\n"
+    << "Frame inviati: " << framesSent << ", ricevuti: " << framesReceived << "\n"
+    << "Durata: " << elapsed << " s, throughput: " << (elapsed > 0 ? framesSent / elapsed : 0) << " frame/s\n"
+    << "Latenza (us) p50: " << percentile(0.50) << " p90: " << percentile(0.90)
+    << " p99: " << percentile(0.99) << " max: " << (latencies.empty() ? 0 : latencies.back()) << "\n";
+  return failedSessions == 0 ? 0 : 2;
+}
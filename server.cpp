@@ -1,121 +1,659 @@
 #include <algorithm>
 #include <arpa/inet.h>
+#include <atomic>
+#include <bit>
 #include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <errno.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <signal.h>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <thread>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 #include <csignal>
 
+#include "frame_codec.h"
+#include "shared_channel.h"
+
 #define PORT 6969
 #define BUFFER_SIZE 1024
 #define MAX_CLIENT 10
+#define MAX_NICKNAME 32
+#define SCOREBOARD_PAGE 10
+#define SCOREBOARD_SUMMARY 5
+#define SCOREBOARD_LOG_SIZE 256
+#define SCOREBOARD_REFRESH_MS 200
+#define POOL_SLAB_BLOCKS 256
+#define CAPTURE_MAGIC "TQCAP001"
+#define CAPTURE_BUFFER_SIZE (1 << 20)
+#define TIMER_TICK_MS 100
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+#define ANSWER_WINDOW_SECONDS 30
+#define IDLE_TIMEOUT_SECONDS 300
+#define OUTPUT_LOW_WATERMARK 4096
+#define OUTPUT_HIGH_WATERMARK 16384
+#define OUTPUT_QUEUE_LIMIT 65536
+#define WRITE_DEADLINE_MS 5000
+#define MAX_CONNECTIONS_PER_IP 32
+#define CONNECTION_RATE 5
+#define MESSAGE_RATE 20
+#define DEFAULT_WORKERS 4
+#define UNIX_SOCKET_PATH "trivia.sock"
+#define MUX_MAX_SESSIONS 1024
+#define MUX_INBOX_LIMIT 8
+#define GATEWAY_MESSAGE_RATE 5000
+#define STATS_MAGIC "TQSTAT01"
+#define ANALYTICS_BUCKETS 9
+#define ANALYTICS_BUCKET_MS 250ULL
+#define ANALYTICS_MERGE_MS 1000
+#define ANALYTICS_DUMP_SECONDS 60
+#define ANALYTICS_CHUNK 256
+#define THEMES_DIRECTORY "themes"
+#define ADMIN_SOCKET_PATH "trivia-admin.sock"
+#define ADMIN_PAGE_LIMIT 1000
+#define COMPRESSION_DICTIONARY_SIZE 960
+#define DICTIONARY_MIN_WORD 4
 
 /*Global variables*/
 std::ofstream logFile("server.log", std::ios::app);
+std::mutex logMutex;
 std::shared_mutex playersMutex;
 std::mutex questionsMutex;
+/*Answer windows given on the command line by theme id and idle timeout, both configurable from the command line*/
+std::unordered_map<int, int> answerWindowOverrides;
+int idleTimeoutSeconds = IDLE_TIMEOUT_SECONDS;
+/*Per address limits, a rate of 0 disables the bucket*/
+int maxConnectionsPerIp = MAX_CONNECTIONS_PER_IP;
+double connectionRate = CONNECTION_RATE;
+double messageRate = MESSAGE_RATE;
+/*Sessions run as coroutines on the worker pool unless the thread per client mode is asked for*/
+bool coroutineMode = true;
+int workerCount = DEFAULT_WORKERS;
+/*Sessions a single multiplexed connection may host, and the cap of its message budget (messageRate per session)*/
+int maxSessionsPerConnection = MUX_MAX_SESSIONS;
+double gatewayMessageRate = GATEWAY_MESSAGE_RATE;
+/*Columnar dump of the per question analytics, empty when disabled*/
+std::string statsFile;
+/*Listener for the clients on the same host and for the admin channel*/
+std::string unixSocketPath = UNIX_SOCKET_PATH;
+std::string adminSocketPath = ADMIN_SOCKET_PATH;
+/*Directory of the question banks, one file per theme*/
+std::string themesDirectory = THEMES_DIRECTORY;
+
+/*Pool of fixed size blocks carved from slabs of POOL_SLAB_BLOCKS, freed blocks go back to a free list and never to the heap*/
+template <size_t BlockSize>
+class BlockPool {
+  public:
+    static BlockPool &instance() {
+      static BlockPool pool;
+      return pool;
+    }
+
+    void *allocate() {
+      std::lock_guard<std::mutex> lock(poolMutex);
+      if (freeList == nullptr) {
+        grow();
+      }
+      FreeBlock *block = freeList;
+      freeList = block->next;
+      return block;
+    }
+
+    void deallocate(void *pointer) {
+      std::lock_guard<std::mutex> lock(poolMutex);
+      FreeBlock *block = static_cast<FreeBlock *>(pointer);
+      block->next = freeList;
+      freeList = block;
+    }
+
+  private:
+    struct FreeBlock {
+      FreeBlock *next;
+    };
+    static constexpr size_t BLOCK = (std::max(BlockSize, sizeof(FreeBlock)) + alignof(std::max_align_t) - 1) /
+      alignof(std::max_align_t) * alignof(std::max_align_t);
+
+    std::mutex poolMutex;
+    FreeBlock *freeList{nullptr};
+    std::vector<std::unique_ptr<std::max_align_t[]>> slabs;
+
+    void grow() {
+      slabs.emplace_back(new std::max_align_t[BLOCK * POOL_SLAB_BLOCKS / sizeof(std::max_align_t)]);
+      char *slab = reinterpret_cast<char *>(slabs.back().get());
+      for (size_t i = 0; i < POOL_SLAB_BLOCKS; ++i) {
+        FreeBlock *block = reinterpret_cast<FreeBlock *>(slab + i * BLOCK);
+        block->next = freeList;
+        freeList = block;
+      }
+    }
+};
+
+/*Standard allocator on top of BlockPool, single objects come from the pool, arrays from the heap*/
+template <typename T>
+struct PoolAllocator {
+  using value_type = T;
+  using pointer = T *;
+  using const_pointer = const T *;
+  using reference = T &;
+  using const_reference = const T &;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+  template <typename U>
+  struct rebind {
+    using other = PoolAllocator<U>;
+  };
+
+  PoolAllocator() = default;
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U> &) {}
+
+  T *allocate(size_t count) {
+    if (count != 1) {
+      return static_cast<T *>(::operator new(count * sizeof(T)));
+    }
+    return static_cast<T *>(BlockPool<sizeof(T)>::instance().allocate());
+  }
+
+  void deallocate(T *pointer, size_t count) {
+    if (count != 1) {
+      ::operator delete(pointer);
+      return;
+    }
+    BlockPool<sizeof(T)>::instance().deallocate(pointer);
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U> &) const { return true; }
+  template <typename U>
+  bool operator!=(const PoolAllocator<U> &) const { return false; }
+};
+
+/*Function to build an object in the pool of its type*/
+template <typename T, typename... Args>
+T *poolNew(Args &&...args) {
+  return new (PoolAllocator<T>().allocate(1)) T(std::forward<Args>(args)...);
+}
+
+/*Function to destroy an object built with poolNew*/
+template <typename T>
+void poolDelete(T *object) {
+  object->~T();
+  PoolAllocator<T>().deallocate(object, 1);
+}
+
+/*Nickname stored inline, copying or comparing it never touches the heap*/
+struct Nickname {
+  char data[MAX_NICKNAME + 1]{};
+  uint8_t length{0};
+
+  Nickname() = default;
+  Nickname(std::string_view name) : length(static_cast<uint8_t>(std::min<size_t>(name.size(), MAX_NICKNAME))) {
+    name.copy(data, length);
+  }
+
+  std::string_view view() const { return std::string_view(data, length); }
+  std::string str() const { return std::string(data, length); }
+  bool operator==(std::string_view other) const { return view() == other; }
+  bool operator<(const Nickname &other) const { return view() < other.view(); }
+};
+
+std::ostream &operator<<(std::ostream &out, const Nickname &nickname) {
+  return out << nickname.view();
+}
 
 /*Questions structure*/
 struct Question {
   std::string question;
   std::string answer;
+  /*Counters of the question in the analytics, set when its bank is installed: the same text of the same theme keeps
+    its counters across reloads, whatever its position*/
+  uint32_t statsId{0};
 };
 
 /*Player structure(all data inside)*/
 struct Player {
-std::string nickname;
-int currentTheme{0};
-int currentQuestionIndex{0};
-int techScore{0};
-int generalScore{0};
-bool hasCompletedTech{false};
-bool hasCompletedGeneral{false};
-
-Player(const std::string& name) : nickname(name) {}
+Nickname nickname;
+/*Row of the player in the score table*/
+uint32_t slot{0};
+/*Connection of the player and its session id there, 0 unless multiplexed*/
+int socket{-1};
+uint32_t session{0};
+/*Set by the admin channel, the session sends KICKED and ends as soon as it is served*/
+std::atomic<bool> kicked{false};
+
+Player(std::string_view name) : nickname(name) {}
 Player() = default;
 };
 
-/*Vector to load questions*/
-std::vector<Question> techQuestions;
-std::vector<Question> generalQuestions;
-/*Vector of players using pair to link player with socket*/
-std::vector<std::pair<int, Player>> players;
+/*Question banks, replaced whole when reloaded: a session keeps the bank it started a theme with*/
+using QuestionBank = std::shared_ptr<const std::vector<Question>>;
+
+/*Theme of the registry, loaded from one file of the themes directory: an optional "# name" first line, then question|answer lines*/
+struct Theme {
+  std::string name;
+  std::string file;
+  QuestionBank bank;
+  int answerWindowSeconds{ANSWER_WINDOW_SECONDS};
+};
+
+/*Theme registry, the id of a theme is its position plus one and never changes while the server runs (a reload only appends).
+  Protected by questionsMutex, themeCount can be read without it*/
+std::vector<Theme> themes;
+std::atomic<int> themeCount{0};
+
+bool validTheme(int theme) {
+  return theme >= 1 && theme <= themeCount.load(std::memory_order_acquire);
+}
+
+/*Function to get the current bank of a theme*/
+QuestionBank questionBank(int theme) {
+  std::lock_guard<std::mutex> lock(questionsMutex);
+  return themes[theme - 1].bank;
+}
+
+size_t bankSize(int theme) {
+  return questionBank(theme)->size();
+}
+
+std::string themeName(int theme) {
+  std::lock_guard<std::mutex> lock(questionsMutex);
+  return themes[theme - 1].name;
+}
+
+int answerWindow(int theme) {
+  std::lock_guard<std::mutex> lock(questionsMutex);
+  return themes[theme - 1].answerWindowSeconds;
+}
+
+/*Vector of players using pair to link player with the socket hosting it (several with a multiplexed connection), the players themselves live in a pool so their address is stable*/
+std::vector<std::pair<int, Player *>> players;
+/*Players by nickname, the key points into the Player itself so it lives as long as the entry*/
+std::unordered_map<std::string_view, Player *> playersByName;
+
+/*Scores and completion bits of every player as one column per theme indexed by the player slot, so ranking a theme,
+  counting its completions or summing its scores walks contiguous memory whatever the number of themes.
+  Protected by playersMutex*/
+class ScoreTable {
+  public:
+    /*Function to give a joining player a slot, freed slots are reused and every column already holds zero there*/
+    uint32_t acquire(Player *player) {
+      if (!freeSlots.empty()) {
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        owners[slot] = player;
+        return slot;
+      }
+      uint32_t slot = owners.size();
+      owners.push_back(player);
+      for (auto &column : scores) {
+        column.push_back(0);
+      }
+      if (slot % 64 == 0) {
+        for (auto &bits : completedBits) {
+          bits.push_back(0);
+        }
+      }
+      return slot;
+    }
+
+    /*Function to free the slot of a leaving player, its scores are cleared so the sums stay right*/
+    void release(uint32_t slot) {
+      for (auto &column : scores) {
+        column[slot] = 0;
+      }
+      for (auto &bits : completedBits) {
+        bits[slot / 64] &= ~(1ull << (slot % 64));
+      }
+      owners[slot] = nullptr;
+      freeSlots.push_back(slot);
+    }
+
+    /*Function to add the columns of a new theme, zero for every slot*/
+    void addTheme() {
+      scores.emplace_back(owners.size(), 0);
+      completedBits.emplace_back((owners.size() + 63) / 64, 0);
+    }
+
+    int score(uint32_t slot, int theme) const { return scores[theme - 1][slot]; }
+    int addPoint(uint32_t slot, int theme) { return ++scores[theme - 1][slot]; }
+
+    bool completed(uint32_t slot, int theme) const {
+      return (completedBits[theme - 1][slot / 64] >> (slot % 64)) & 1;
+    }
+
+    void complete(uint32_t slot, int theme) {
+      completedBits[theme - 1][slot / 64] |= 1ull << (slot % 64);
+    }
+
+    bool completedAll(uint32_t slot) const {
+      for (const auto &bits : completedBits) {
+        if (!((bits[slot / 64] >> (slot % 64)) & 1)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    size_t completions(int theme) const {
+      size_t count = 0;
+      for (uint64_t word : completedBits[theme - 1]) {
+        count += std::popcount(word);
+      }
+      return count;
+    }
+
+    uint64_t totalScore(int theme) const {
+      uint64_t total = 0;
+      for (int32_t score : scores[theme - 1]) {
+        total += score;
+      }
+      return total;
+    }
+
+    /*Function to visit the players that completed a theme in slot order, stops when visit returns false*/
+    template <typename Visit>
+    void forEachCompleted(int theme, Visit visit) const {
+      const std::vector<uint64_t> &bits = completedBits[theme - 1];
+      for (size_t word = 0; word < bits.size(); ++word) {
+        for (uint64_t rest = bits[word]; rest != 0; rest &= rest - 1) {
+          if (!visit(*owners[word * 64 + std::countr_zero(rest)])) {
+            return;
+          }
+        }
+      }
+    }
+
+  private:
+    std::vector<std::vector<int32_t>> scores;
+    std::vector<std::vector<uint64_t>> completedBits;
+    std::vector<Player *> owners;
+    std::vector<uint32_t> freeSlots;
+};
+
+ScoreTable scoreTable;
+
+/*Ranking key: negated score so the best player comes first, ties broken by nickname*/
+using RankKey = std::pair<int, Nickname>;
+/*Order statistics tree, gives top-K and rank of a player in O(log n) without sorting, nodes are recycled by the pool*/
+using RankTree = __gnu_pbds::tree<RankKey, __gnu_pbds::null_type, std::less<RankKey>,
+      __gnu_pbds::rb_tree_tag, __gnu_pbds::tree_order_statistics_node_update, PoolAllocator<char>>;
+
+/*Single scoreboard change, theme 0 means the player left the game and -1 that it joined with every score at zero*/
+struct ScoreChange {
+  uint64_t version{0};
+  int theme{0};
+  Nickname nickname;
+  int score{0};
+};
+
+/*Rankings per theme (a deque so adding a theme never moves the others) and ring of the last changes, all protected by playersMutex*/
+std::deque<RankTree> rankings;
+std::vector<ScoreChange> scoreChanges(SCOREBOARD_LOG_SIZE);
+uint64_t scoreboardVersion = 0;
+
+/*Timer node, embedded in the object that owns it so arming never allocates*/
+struct Timer {
+  Timer *prev{nullptr};
+  Timer *next{nullptr};
+  uint64_t expiresTick{0};
+  void (*callback)(void *){nullptr};
+  void *context{nullptr};
+};
+
+/*Hierarchical timer wheel: TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots, arm and cancel are O(1).
+  Callbacks run with the wheel locked so they must be short and must not arm or cancel timers.
+  advance() does not care who calls it, a ticker thread or an event loop*/
+class TimerWheel {
+  public:
+    TimerWheel() : start(std::chrono::steady_clock::now()) {
+      for (auto &level : slots) {
+        for (auto &head : level) {
+          head.prev = head.next = &head;
+        }
+      }
+    }
+
+    /*Function to (re)arm a timer, the delay is rounded up to the next tick*/
+    void arm(Timer &timer, std::chrono::milliseconds delay) {
+      std::lock_guard<std::mutex> lock(wheelMutex);
+      unlink(timer);
+      uint64_t ticks = std::max<int64_t>(1, (delay.count() + TIMER_TICK_MS - 1) / TIMER_TICK_MS);
+      timer.expiresTick = currentTick + std::min<uint64_t>(ticks, MAX_DELAY);
+      insert(timer);
+    }
+
+    /*Function to cancel a timer, once it returns the callback is not running and will not run*/
+    void cancel(Timer &timer) {
+      std::lock_guard<std::mutex> lock(wheelMutex);
+      unlink(timer);
+    }
+
+    /*Function to fire every timer expired up to now, cascading the upper levels when a lower one wraps*/
+    void advance(std::chrono::steady_clock::time_point now) {
+      std::lock_guard<std::mutex> lock(wheelMutex);
+      uint64_t target = std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() / TIMER_TICK_MS;
+      while (currentTick < target) {
+        ++currentTick;
+        for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; --level) {
+          if ((currentTick & ((1ull << (TIMER_WHEEL_BITS * level)) - 1)) == 0) {
+            cascade(level, (currentTick >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+          }
+        }
+        Timer &head = slots[0][currentTick & (TIMER_WHEEL_SLOTS - 1)];
+        while (head.next != &head) {
+          Timer *timer = head.next;
+          unlink(*timer);
+          timer->callback(timer->context);
+        }
+      }
+    }
+
+  private:
+    static constexpr uint64_t MAX_DELAY = (1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+
+    std::mutex wheelMutex;
+    std::chrono::steady_clock::time_point start;
+    uint64_t currentTick{0};
+    Timer slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+    void insert(Timer &timer) {
+      uint64_t delta = timer.expiresTick - currentTick;
+      int level = 0;
+      while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ull << (TIMER_WHEEL_BITS * (level + 1)))) {
+        ++level;
+      }
+      Timer &head = slots[level][(timer.expiresTick >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+      timer.prev = &head;
+      timer.next = head.next;
+      head.next->prev = &timer;
+      head.next = &timer;
+    }
+
+    void unlink(Timer &timer) {
+      if (timer.prev != nullptr) {
+        timer.prev->next = timer.next;
+        timer.next->prev = timer.prev;
+        timer.prev = timer.next = nullptr;
+      }
+    }
+
+    /*Moves the timers of an upper slot down, they now expire within the range of a lower level*/
+    void cascade(int level, uint64_t slot) {
+      Timer &head = slots[level][slot];
+      while (head.next != &head) {
+        Timer *timer = head.next;
+        unlink(*timer);
+        insert(*timer);
+      }
+    }
+};
+
+TimerWheel timerWheel;
 
-/*Function to log messages with timestamps*/
-void logMessage(const std::string &message) {
+/*Log levels, per frame lines are debug and everything else is info*/
+enum LogLevel { LOG_DEBUG, LOG_INFO, LOG_OFF };
+std::atomic<int> logLevel{LOG_DEBUG};
+
+/*Function to log messages with timestamps, the parts are streamed one by one so no temporary string is built*/
+template <typename... Parts>
+void logMessage(const Parts &...parts) {
+  if (logLevel.load(std::memory_order_relaxed) > LOG_INFO) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(logMutex);
   auto now = std::chrono::system_clock::now();
-  logFile << "[" << std::chrono::system_clock::to_time_t(now) << "] " << message << std::endl;
+  logFile << "[" << std::chrono::system_clock::to_time_t(now) << "] ";
+  (logFile << ... << parts) << std::endl;
+}
+
+/*Function to log the lines written for every frame, skipped unless the level is debug*/
+template <typename... Parts>
+void logDebug(const Parts &...parts) {
+  if (logLevel.load(std::memory_order_relaxed) == LOG_DEBUG) {
+    logMessage(parts...);
+  }
+}
+
+/*Function to store a change in the ring used for delta updates, caller holds playersMutex*/
+void recordScoreChange(int theme, const Nickname &nickname, int score) {
+  ScoreChange &change = scoreChanges[scoreboardVersion % SCOREBOARD_LOG_SIZE];
+  change.version = ++scoreboardVersion;
+  change.theme = theme;
+  change.nickname = nickname;
+  change.score = score;
+}
+
+/*Function to move a player inside the ranking of a theme, caller holds playersMutex*/
+void updateRanking(int theme, const Nickname &nickname, int oldScore, int newScore) {
+  RankTree &ranking = rankings[theme - 1];
+  ranking.erase(RankKey(-oldScore, nickname));
+  ranking.insert(RankKey(-newScore, nickname));
+  recordScoreChange(theme, nickname, newScore);
+}
+
+/*Function to add a new player to every ranking, caller holds playersMutex*/
+void addToRankings(const Player &player) {
+  for (RankTree &ranking : rankings) {
+    ranking.insert(RankKey(0, player.nickname));
+  }
+  recordScoreChange(-1, player.nickname, 0);
+}
+
+/*Function to remove a leaving player from every ranking, caller holds playersMutex*/
+void removeFromRankings(const Player &player) {
+  for (size_t theme = 1; theme <= rankings.size(); ++theme) {
+    rankings[theme - 1].erase(RankKey(-scoreTable.score(player.slot, theme), player.nickname));
+  }
+  recordScoreChange(0, player.nickname, 0);
+}
+
+/*Function to append a line only if the message still fits in the limit (BUFFER_SIZE by default)*/
+bool appendLine(std::string &out, const std::string &line, size_t limit = BUFFER_SIZE) {
+  if (out.size() + line.size() + 1 > limit) {
+    return false;
+  }
+  out += line;
+  out += '\n';
+  return true;
+}
+
+/*Function to append the ranking entries in [first, first + count) of a theme while they fit `limit`, caller holds playersMutex*/
+bool appendRanking(std::string &out, int theme, size_t first, size_t count, size_t questionCount, size_t limit = BUFFER_SIZE) {
+  const RankTree &ranking = rankings[theme - 1];
+  auto it = ranking.find_by_order(first);
+  for (size_t rank = first; rank < first + count && it != ranking.end(); ++rank, ++it) {
+    if (!appendLine(out, std::to_string(rank + 1) + ". " + it->second.str() + ": " +
+          std::to_string(-it->first) + "/" + std::to_string(questionCount), limit - 32)) {
+      return false;
+    }
+  }
+  return true;
 }
 
-/*Function to print scoreboard, sorts by scores using stringstream to make easy format*/
+/*Set when the console is out of date, the console thread redraws at most every SCOREBOARD_REFRESH_MS*/
+std::atomic<bool> scoreboardDirty{true};
+
+/*Function to ask for a console refresh, cheap enough for the answer path*/
 void printScoreboard() {
+  scoreboardDirty.store(true, std::memory_order_release);
+}
+
+/*Function to draw the scoreboard, walks the rankings and the score columns so nothing is copied or sorted.
+  Lists stop after SCOREBOARD_PAGE names, the console has to stay readable with many themes and players*/
+void drawScoreboard() {
   logMessage("********** PRINTING SCOREBOARD **********");
+  std::vector<std::pair<std::string, size_t>> themeInfo;
+  {
+    std::lock_guard<std::mutex> lock(questionsMutex);
+    for (const Theme &theme : themes) {
+      themeInfo.emplace_back(theme.name, theme.bank->size());
+    }
+  }
   std::stringstream ss;
   ss << "\033[2J\033[H";
   ss << "\t\033[1;36m    ==- Trivia Quiz -==\033[0m\n"
     << "++++++++++++++++++++++++++++++++++++++++\n"
-    << "Temi disponibili:\n"
-    << "1- Curiosita sulla tecnologia\n"
-    << "2- Cultura Generale\n"
-    << "+++++++++++++++++++++++++++++++++++++++\n";
+    << "Temi disponibili:\n";
+  for (size_t theme = 1; theme <= themeInfo.size(); ++theme) {
+    ss << theme << "- " << themeInfo[theme - 1].first << "\n";
+  }
+  ss << "+++++++++++++++++++++++++++++++++++++++\n";
 
   {
     std::shared_lock<std::shared_mutex> lock(playersMutex);
     ss << "Partecipanti attivi (" << players.size() << ")\n";
-    for (const auto &player_pair : players) {
-      const auto &player = player_pair.second;
-      ss << "x " << player.nickname << "\n";
+    for (size_t index = 0; index < players.size() && index < SCOREBOARD_PAGE; ++index) {
+      ss << "x " << players[index].second->nickname << "\n";
     }
-
-    ss << "\nPuntaggi Tecnologia:\n";
-    /*Sorting players by tech score*/
-    std::vector<std::pair<int, Player>> sortedPlayersTech = players;
-    std::sort(sortedPlayersTech.begin(), sortedPlayersTech.end(), [](const auto &a, const auto &b) {
-        return a.second.techScore > b.second.techScore;
-        });
-    /*Printing sorted players*/
-    for (const auto &player_pair : sortedPlayersTech) {
-      const auto &player = player_pair.second;
-      ss << "-> " << player.nickname << ": " << player.techScore << "/" << techQuestions.size() << "\n";
-    }
-
-    ss << "\nPuntaggi Cultura Generale:\n";
-    /*Sortting players by general score*/
-    std::vector<std::pair<int, Player>> sortedPlayersGeneral = players;
-    std::sort(sortedPlayersGeneral.begin(), sortedPlayersGeneral.end(), [](const auto &a, const auto &b) {
-        return a.second.generalScore > b.second.generalScore;
-        });
-    /*Printing sorted players*/
-    for (const auto &player_pair : sortedPlayersGeneral) {
-      const auto &player = player_pair.second;
-      ss << "-> " << player.nickname << ": " << player.generalScore << "/" << generalQuestions.size() << "\n";
+    if (players.size() > SCOREBOARD_PAGE) {
+      ss << "x ... e altri " << players.size() - SCOREBOARD_PAGE << "\n";
     }
 
-    ss << "\nQuiz Tecnologia completati:\n";
-    for (const auto &player_pair : players) {
-      const auto &player = player_pair.second;
-      if (player.hasCompletedTech) {
-        ss << "-> " << player.nickname << "\n";
+    /*Themes added by a reload appear once their ranking exists*/
+    for (size_t theme = 1; theme <= themeInfo.size() && theme <= rankings.size(); ++theme) {
+      const auto &[name, questionCount] = themeInfo[theme - 1];
+      size_t completions = scoreTable.completions(theme);
+      double average = players.empty() ? 0 : static_cast<double>(scoreTable.totalScore(theme)) / players.size();
+      ss << "\nPuntaggi " << name << " (media " << average << "/" << questionCount << "):\n";
+      size_t shown = 0;
+      for (auto it = rankings[theme - 1].begin(); it != rankings[theme - 1].end() && shown < SCOREBOARD_PAGE; ++it, ++shown) {
+        ss << "-> " << it->second << ": " << -it->first << "/" << questionCount << "\n";
       }
-    }
 
-    ss << "\nQuiz Cultura Generale completati:\n";
-    for (const auto &player_pair : players) {
-      const auto &player = player_pair.second;
-      if (player.hasCompletedGeneral) {
-        ss << "-> " << player.nickname << "\n";
-      }
+      ss << "Quiz " << name << " completati (" << completions << "):\n";
+      shown = 0;
+      scoreTable.forEachCompleted(theme, [&](const Player &player) {
+          ss << "-> " << player.nickname << "\n";
+          return ++shown < SCOREBOARD_PAGE;
+          });
     }
   }
 
@@ -124,10 +662,19 @@ void printScoreboard() {
   fflush(stdout);
 }
 
+/*Function run by the console thread, coalesces the refresh requests of all the clients*/
+void consoleThread() {
+  while (true) {
+    if (scoreboardDirty.exchange(false, std::memory_order_acquire)) {
+      drawScoreboard();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(SCOREBOARD_REFRESH_MS));
+  }
+}
+
 /*Function to load questions from file*/
 std::vector<Question> loadQuestions(const std::string &filename) {
   try {
-    std::lock_guard<std::mutex> lock(questionsMutex);
     std::vector<Question> questions;
     std::ifstream file(filename);
     if (!file.is_open()) {
@@ -145,378 +692,2585 @@ std::vector<Question> loadQuestions(const std::string &filename) {
     }
     return questions;
   } catch (const std::exception &e) {
-    logMessage("Exception in loadQuestions: " + std::string(e.what()));
+    logMessage("Exception in loadQuestions: ", e.what());
     return {};
   }
 }
 
-/*After client acepting to finish the quiz, the server will send a message to the client to close the connection and remove the client data from the server*/
-void removeClientData(int clientSocket) {
-  {
-    std::unique_lock<std::shared_mutex> lock(playersMutex);
-    auto it = std::find_if(players.begin(), players.end(),
-        [clientSocket](const std::pair<int, Player> &player) {
-        return player.first == clientSocket;
-        });
-    if (it != players.end()) {
-      logMessage("Removing data for client: " + it->second.nickname);
-      players.erase(it);
-    } else {
-      logMessage("Client data not found for socket: " + std::to_string(clientSocket));
+/*Function to read the name of a theme from the "# name" first line of its bank, the file name otherwise*/
+std::string loadThemeName(const std::filesystem::path &path) {
+  std::ifstream file(path);
+  std::string line;
+  if (std::getline(file, line) && line.rfind("#", 0) == 0) {
+    size_t start = line.find_first_not_of("# \t");
+    size_t end = line.find_last_not_of(" \t\r");
+    if (start != std::string::npos) {
+      return line.substr(start, end - start + 1);
     }
   }
-  printScoreboard();
+  return path.stem().string();
 }
 
-/*Function to send messages to the client, first sends the length of the message and then the message itself*/
-bool secureSend(int clientSocket, const std::string &message) {
-  try {
-    uint32_t messageLength = htonl(message.size());
-    if (send(clientSocket, &messageLength, sizeof(messageLength), 0) < 0) {
-      logMessage("Error sending message length");
-      return false;
+/*Function to load the themes directory: themes already known keep their id, new bank files are appended in name order.
+  Fails without touching the registry when a known bank disappeared or a bank has no questions*/
+bool loadThemes(std::vector<Theme> &loaded, std::string &error) {
+  std::vector<std::string> files;
+  std::error_code code;
+  for (const auto &entry : std::filesystem::directory_iterator(themesDirectory, code)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".txt") {
+      files.push_back(entry.path().filename().string());
     }
-    if (send(clientSocket, message.c_str(), message.size(), 0) < 0) {
-      logMessage("Error sending message");
-      return false;
-    }
-    logMessage("Sent message of size: " + std::to_string(message.size()));
-    return true;
-  } catch (const std::exception &e) {
-    logMessage("Exception in secureSend: " + std::string(e.what()));
+  }
+  if (code) {
+    error = "cartella dei temi non leggibile: " + themesDirectory;
     return false;
   }
-}
-
-/*Function to receive messages from the client, first receives the length of the message and then the message itself*/
-bool secureReceive(int clientSocket, std::string &message) {
-  try {
-    uint32_t messageLength = 0;
-    int bytesReceived = recv(clientSocket, &messageLength, sizeof(messageLength), 0);
-    if (bytesReceived <= 0) {
-      if (bytesReceived == 0) {
-        struct sockaddr_in peerAddr;
-        socklen_t peerAddrLen = sizeof(peerAddr);
-        if (getpeername(clientSocket, (struct sockaddr *)&peerAddr, &peerAddrLen) == 0) {
-          char clientIP[INET_ADDRSTRLEN];
-          inet_ntop(AF_INET, &peerAddr.sin_addr, clientIP, sizeof(clientIP));
-          logMessage("Client disconnected: " + std::string(clientIP) + ":" + std::to_string(ntohs(peerAddr.sin_port)));
-          std::cout << "Client disconnected: " << clientIP << ":" << ntohs(peerAddr.sin_port) << std::endl;
-        } else {
-          logMessage("Client disconnected (error getting address)");
-        }
-        removeClientData(clientSocket);
-      } else {
-        logMessage("Error receiving message length");
-      }
+  std::sort(files.begin(), files.end());
+  {
+    std::lock_guard<std::mutex> lock(questionsMutex);
+    loaded = themes;
+  }
+  for (const Theme &theme : loaded) {
+    if (!std::binary_search(files.begin(), files.end(), theme.file)) {
+      error = "manca il file del tema " + theme.file;
       return false;
     }
-    messageLength = ntohl(messageLength);
-    if (messageLength > BUFFER_SIZE) {
-      logMessage("Message too large");
-      return false;
+  }
+  for (const std::string &file : files) {
+    if (std::none_of(loaded.begin(), loaded.end(), [&file](const Theme &theme) { return theme.file == file; })) {
+      loaded.push_back(Theme{"", file, nullptr});
     }
-    std::vector<char> buffer(messageLength + 1);
-    bytesReceived = recv(clientSocket, buffer.data(), messageLength, 0);
-    if (bytesReceived <= 0) {
-      if (bytesReceived == 0) {
-        struct sockaddr_in peerAddr;
-        socklen_t peerAddrLen = sizeof(peerAddr);
-        if (getpeername(clientSocket, (struct sockaddr *)&peerAddr, &peerAddrLen) == 0) {
-          char clientIP[INET_ADDRSTRLEN];
-          inet_ntop(AF_INET, &peerAddr.sin_addr, clientIP, sizeof(clientIP));
-          logMessage("Client disconnected: " + std::string(clientIP) + ":" + std::to_string(ntohs(peerAddr.sin_port)));
-          std::cout << "Client disconnected: " << clientIP << ":" << ntohs(peerAddr.sin_port) << std::endl;
-        } else {
-          logMessage("Client disconnected (error getting address)");
-        }
-        removeClientData(clientSocket);
-      } else {
-        logMessage("Error receiving message");
-      }
+  }
+  if (loaded.empty()) {
+    error = "nessun tema in " + themesDirectory;
+    return false;
+  }
+  for (size_t index = 0; index < loaded.size(); ++index) {
+    Theme &theme = loaded[index];
+    std::filesystem::path path = std::filesystem::path(themesDirectory) / theme.file;
+    std::vector<Question> questions = loadQuestions(path.string());
+    if (questions.empty()) {
+      error = "nessuna domanda in " + theme.file;
       return false;
     }
-    buffer[messageLength] = '\0';
-    message = buffer.data();
-    logMessage("Received message of size: " + std::to_string(message.size()));
-    logMessage("Received: " + message);
-    return true;
-  } catch (const std::exception &e) {
-    logMessage("Exception in secureReceive: " + std::string(e.what()));
-    return false;
+    theme.name = loadThemeName(path);
+    theme.bank = std::make_shared<const std::vector<Question>>(std::move(questions));
+    auto window = answerWindowOverrides.find(index + 1);
+    theme.answerWindowSeconds = (window != answerWindowOverrides.end()) ? window->second : ANSWER_WINDOW_SECONDS;
   }
+  return true;
 }
 
-/*Function to send the scoreboard to the client*/
-void sendScoreboard(int clientSocket) {
-  try {
-    std::ostringstream scoreboard;
-    scoreboard << "\n=== PUNTEGGI ATTUALI ===\n\n";
+/*Kind of record stored in a capture file*/
+enum CaptureRecord : uint8_t { CAPTURE_OPEN = 1, CAPTURE_INBOUND, CAPTURE_OUTBOUND, CAPTURE_CLOSE };
 
-    {
-      std::shared_lock<std::shared_mutex> lock(playersMutex);
+/*Traffic recorder: every inbound frame with its session id and timestamp, plus the size of every outbound frame
+  so the replay knows how many replies to wait for. Records are little endian:
+  type u8, session u32, nanoseconds since start u64, length u32, payload (inbound only)*/
+class TrafficRecorder {
+  public:
+    /*Set once before the first client is accepted, when false the framing path only pays this check*/
+    bool enabled{false};
+
+    bool open(const std::string &path) {
+      file = fopen(path.c_str(), "wb");
+      if (file == nullptr) {
+        return false;
+      }
+      setvbuf(file, nullptr, _IOFBF, CAPTURE_BUFFER_SIZE);
+      fwrite(CAPTURE_MAGIC, 1, 8, file);
+      start = std::chrono::steady_clock::now();
+      enabled = true;
+      return true;
+    }
 
-    std::vector<std::pair<std::string, std::pair<int, int>>> scores;
-    for (const auto &player : players) {
-        scores.emplace_back(player.second.nickname, 
-            std::make_pair(player.second.techScore, player.second.generalScore));
+    void record(CaptureRecord type, uint32_t sessionId, uint32_t length, const char *payload) {
+      uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+      std::lock_guard<std::mutex> lock(recorderMutex);
+      fwrite(&type, sizeof(type), 1, file);
+      fwrite(&sessionId, sizeof(sessionId), 1, file);
+      fwrite(&timestamp, sizeof(timestamp), 1, file);
+      fwrite(&length, sizeof(length), 1, file);
+      if (payload != nullptr) {
+        fwrite(payload, 1, length, file);
+      }
     }
 
-    scoreboard << "Quiz Tecnologia:\n";
-    std::sort(scores.begin(), scores.end(),
-        [](const auto &a, const auto &b) { return a.second.first > b.second.first; });
-    for (const auto &score : scores) {
-        scoreboard << score.first << ": " << score.second.first << "/" 
-                << techQuestions.size() << " punti\n";
+    void flush() {
+      std::unique_lock<std::mutex> lock(recorderMutex, std::try_to_lock);
+      if (file != nullptr && lock.owns_lock()) {
+        fflush(file);
+      }
     }
 
-    scoreboard << "\nQuiz Cultura Generale:\n";
-    std::sort(scores.begin(), scores.end(),
-        [](const auto &a, const auto &b) { return a.second.second > b.second.second; });
+  private:
+    std::mutex recorderMutex;
+    FILE *file{nullptr};
+    std::chrono::steady_clock::time_point start;
+};
+
+TrafficRecorder recorder;
 
-    for (const auto &score : scores) {
-    scoreboard << score.first << ": " << score.second.second << "/" 
-                << generalQuestions.size() << " punti\n";
-    }
-    }
+/*Outcome of a question for the analytics*/
+enum QuestionOutcome { OUTCOME_CORRECT, OUTCOME_INCORRECT, OUTCOME_TIMEOUT };
 
-    secureSend(clientSocket, scoreboard.str());
-  } catch (const std::exception &e) {
-    logMessage("Exception in sendScoreboard: " + std::string(e.what()));
+/*Counters of one question inside a shard, written by the owner thread only*/
+struct QuestionCounters {
+  std::atomic<uint64_t> attempts{0};
+  std::atomic<uint64_t> correct{0};
+  std::atomic<uint64_t> incorrect{0};
+  std::atomic<uint64_t> timeouts{0};
+  std::atomic<uint64_t> totalMilliseconds{0};
+  std::atomic<uint64_t> histogram[ANALYTICS_BUCKETS]{};
+};
+
+/*Counters of every question for the thread that owns the shard, in chunks of ANALYTICS_CHUNK by statsId.
+  Only the owner adds chunks, under shardsMutex, so the merge never sees the table move*/
+struct AnalyticsShard {
+  std::vector<std::unique_ptr<QuestionCounters[]>> chunks;
+};
+
+/*Merged view of a question, the histogram bucket i counts answers under 250ms << i (the last one everything slower)*/
+struct QuestionStats {
+  uint64_t attempts{0};
+  uint64_t correct{0};
+  uint64_t incorrect{0};
+  uint64_t timeouts{0};
+  uint64_t totalMilliseconds{0};
+  uint64_t histogram[ANALYTICS_BUCKETS]{};
+
+  /*Upper bound of the bucket holding the median response time, 0 without attempts*/
+  uint64_t medianMilliseconds() const {
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < ANALYTICS_BUCKETS; ++bucket) {
+      seen += histogram[bucket];
+      if (attempts > 0 && 2 * seen >= attempts) {
+        return ANALYTICS_BUCKET_MS << bucket;
+      }
+    }
+    return 0;
   }
-}
+};
 
-/*Function to handle the client, first receives the nickname, then the theme selection, then the questions and answers, then the scoreboard and finally the end of the quiz*/
-void handleClient(int clientSocket) {
-  logMessage("********** ENTERING handleClient **********");
-  try {
-    std::string message;
-    if (!secureReceive(clientSocket, message)) {
-      close(clientSocket);
-      removeClientData(clientSocket);
-      return;
+/*Per question analytics. The answer path only bumps relaxed counters of its own thread's shard, no lock and no shared
+  cache line; the analytics thread sums the shards into a snapshot that queries and dumps read*/
+class QuestionAnalytics {
+  public:
+    /*Function to give every question of the registry its statsId, at startup and when the banks are reloaded.
+      Ids are keyed by theme and question text and never reused, so unchanged questions keep counting (a session on an old
+      bank included) and the counters of a retired question are kept should it come back. The snapshot follows the new
+      positions at once*/
+    void configure(std::vector<Theme> &loaded) {
+      {
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        layout.assign(loaded.size(), {});
+        for (size_t theme = 0; theme < loaded.size(); ++theme) {
+          std::vector<Question> questions = *loaded[theme].bank;
+          for (Question &question : questions) {
+            auto [entry, created] = questionIds.try_emplace(std::to_string(theme + 1) + "\n" + question.question,
+                static_cast<uint32_t>(questionIds.size()));
+            question.statsId = entry->second;
+            layout[theme].push_back(question.statsId);
+          }
+          loaded[theme].bank = std::make_shared<const std::vector<Question>>(std::move(questions));
+        }
+      }
+      merge();
     }
-    if (message == "START") {
-      while (true) {
-        if (!secureReceive(clientSocket, message)) {
-          close(clientSocket);
-          removeClientData(clientSocket);
-          return;
+
+    void record(const Question &question, QuestionOutcome outcome, uint64_t milliseconds) {
+      AnalyticsShard *shard = localShard();
+      size_t chunk = question.statsId / ANALYTICS_CHUNK;
+      if (chunk >= shard->chunks.size()) {
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        while (shard->chunks.size() <= chunk) {
+          shard->chunks.push_back(std::make_unique<QuestionCounters[]>(ANALYTICS_CHUNK));
         }
-        bool nicknameTaken = false;
-        {
-          std::shared_lock<std::shared_mutex> lock(playersMutex);
-          for (const auto &player : players) {
-            if (player.second.nickname == message) {
-              nicknameTaken = true;
-              break;
+      }
+      QuestionCounters &counters = shard->chunks[chunk][question.statsId % ANALYTICS_CHUNK];
+      bump(counters.attempts, 1);
+      bump((outcome == OUTCOME_CORRECT) ? counters.correct :
+          ((outcome == OUTCOME_INCORRECT) ? counters.incorrect : counters.timeouts), 1);
+      bump(counters.totalMilliseconds, milliseconds);
+      int bucket = std::min<int>(ANALYTICS_BUCKETS - 1, std::bit_width(milliseconds / ANALYTICS_BUCKET_MS));
+      bump(counters.histogram[bucket], 1);
+    }
+
+    /*Function to sum every shard into the snapshot, laid out by theme and position in the current banks*/
+    void merge() {
+      std::vector<std::vector<QuestionStats>> totals;
+      {
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        totals.resize(layout.size());
+        for (size_t theme = 0; theme < layout.size(); ++theme) {
+          totals[theme].resize(layout[theme].size());
+          for (size_t question = 0; question < layout[theme].size(); ++question) {
+            uint32_t statsId = layout[theme][question];
+            QuestionStats &stats = totals[theme][question];
+            for (const auto &shard : shards) {
+              if (statsId / ANALYTICS_CHUNK >= shard->chunks.size()) {
+                continue;
+              }
+              const QuestionCounters &counters = shard->chunks[statsId / ANALYTICS_CHUNK][statsId % ANALYTICS_CHUNK];
+              stats.attempts += counters.attempts.load(std::memory_order_relaxed);
+              stats.correct += counters.correct.load(std::memory_order_relaxed);
+              stats.incorrect += counters.incorrect.load(std::memory_order_relaxed);
+              stats.timeouts += counters.timeouts.load(std::memory_order_relaxed);
+              stats.totalMilliseconds += counters.totalMilliseconds.load(std::memory_order_relaxed);
+              for (int bucket = 0; bucket < ANALYTICS_BUCKETS; ++bucket) {
+                stats.histogram[bucket] += counters.histogram[bucket].load(std::memory_order_relaxed);
+              }
             }
           }
         }
-        if (nicknameTaken) {
-          secureSend(clientSocket, "NICKNAME_ALREADY_USED");
+      }
+      std::unique_lock<std::shared_mutex> lock(snapshotMutex);
+      merged.swap(totals);
+    }
+
+    /*Function to append the merged stats of a range of questions, one line each while they fit a frame*/
+    void appendStats(std::string &out, int theme, size_t first, size_t count, size_t limit = BUFFER_SIZE) const {
+      std::shared_lock<std::shared_mutex> lock(snapshotMutex);
+      if (static_cast<size_t>(theme) > merged.size()) {
+        return;
+      }
+      const std::vector<QuestionStats> &stats = merged[theme - 1];
+      for (size_t question = first; question < stats.size() && question < first + count; ++question) {
+        const QuestionStats &entry = stats[question];
+        std::string line = "#" + std::to_string(question + 1) + " tentativi " + std::to_string(entry.attempts) +
+          " corrette " + std::to_string(entry.correct) + " errate " + std::to_string(entry.incorrect) +
+          " scadute " + std::to_string(entry.timeouts) + " mediana " + std::to_string(entry.medianMilliseconds()) + "ms";
+        if (!appendLine(out, line, limit - 32)) {
+          break;
+        }
+      }
+    }
+
+    /*Function to write the snapshot as columns: a header naming every u64 column, then each column contiguous.
+      Written to a temporary file and renamed, so readers never see a partial dump*/
+    bool dump(const std::string &path) const {
+      std::vector<std::pair<std::string, std::vector<uint64_t>>> columns;
+      {
+        std::shared_lock<std::shared_mutex> lock(snapshotMutex);
+        const char *names[] = {"theme", "question", "attempts", "correct", "incorrect", "timeouts", "total_ms"};
+        for (const char *name : names) {
+          columns.emplace_back(name, std::vector<uint64_t>());
+        }
+        for (int bucket = 0; bucket < ANALYTICS_BUCKETS; ++bucket) {
+          columns.emplace_back("lt_" + std::to_string(ANALYTICS_BUCKET_MS << bucket) + "ms", std::vector<uint64_t>());
+        }
+        columns.back().first = "slower";
+        for (size_t theme = 0; theme < merged.size(); ++theme) {
+          for (size_t question = 0; question < merged[theme].size(); ++question) {
+            const QuestionStats &entry = merged[theme][question];
+            uint64_t values[] = {static_cast<uint64_t>(theme + 1), question + 1, entry.attempts, entry.correct,
+              entry.incorrect, entry.timeouts, entry.totalMilliseconds};
+            size_t column = 0;
+            for (uint64_t value : values) {
+              columns[column++].second.push_back(value);
+            }
+            for (int bucket = 0; bucket < ANALYTICS_BUCKETS; ++bucket) {
+              columns[column++].second.push_back(entry.histogram[bucket]);
+            }
+          }
+        }
+      }
+      std::string temporary = path + ".tmp";
+      FILE *file = fopen(temporary.c_str(), "wb");
+      if (file == nullptr) {
+        logMessage("Unable to write stats file: ", temporary);
+        return false;
+      }
+      uint32_t rows = columns[0].second.size();
+      uint32_t columnCount = columns.size();
+      fwrite(STATS_MAGIC, 1, 8, file);
+      fwrite(&rows, sizeof(rows), 1, file);
+      fwrite(&columnCount, sizeof(columnCount), 1, file);
+      for (const auto &column : columns) {
+        uint8_t nameLength = column.first.size();
+        fwrite(&nameLength, sizeof(nameLength), 1, file);
+        fwrite(column.first.data(), 1, nameLength, file);
+      }
+      for (const auto &column : columns) {
+        fwrite(column.second.data(), sizeof(uint64_t), rows, file);
+      }
+      bool written = fclose(file) == 0;
+      return written && rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+  private:
+    std::mutex shardsMutex;
+    /*statsId of every theme and question text ever installed, and the statsId at each position of the current banks*/
+    std::unordered_map<std::string, uint32_t> questionIds;
+    std::vector<std::vector<uint32_t>> layout;
+    /*Shards live as long as the server, a reload does not touch them*/
+    std::vector<std::unique_ptr<AnalyticsShard>> shards;
+    std::vector<AnalyticsShard *> freeShards;
+    mutable std::shared_mutex snapshotMutex;
+    std::vector<std::vector<QuestionStats>> merged;
+
+    /*Single writer per shard, so a plain load and store is enough and avoids a locked instruction*/
+    static void bump(std::atomic<uint64_t> &counter, uint64_t amount) {
+      counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    /*Shard of the calling thread. A thread that exits gives its shard back with the counts in it, the next thread reuses it*/
+    AnalyticsShard *localShard() {
+      struct Lease {
+        QuestionAnalytics *owner{nullptr};
+        AnalyticsShard *shard{nullptr};
+        ~Lease() {
+          if (shard != nullptr) {
+            std::lock_guard<std::mutex> lock(owner->shardsMutex);
+            owner->freeShards.push_back(shard);
+          }
+        }
+      };
+      thread_local Lease lease;
+      if (lease.shard == nullptr) {
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        if (!freeShards.empty()) {
+          lease.shard = freeShards.back();
+          freeShards.pop_back();
+        } else {
+          shards.push_back(std::make_unique<AnalyticsShard>());
+          lease.shard = shards.back().get();
+        }
+        /*Sized for every question known now, only a reload that adds questions makes the answer path grow it*/
+        while (lease.shard->chunks.size() * ANALYTICS_CHUNK < questionIds.size()) {
+          lease.shard->chunks.push_back(std::make_unique<QuestionCounters[]>(ANALYTICS_CHUNK));
+        }
+        lease.owner = this;
+      }
+      return lease.shard;
+    }
+};
+
+QuestionAnalytics analytics;
+
+/*Preset dictionary of the compressed frames, handed to each client in COMPRESS_READY. Rebuilt with the registry,
+  a connection keeps the one it negotiated. Protected by questionsMutex*/
+std::shared_ptr<const std::string> compressionDictionary;
+
+/*Fixed vocabulary of the large server frames: scoreboards, rankings, stats and theme lists*/
+const char *const dictionaryVocabulary[] = {
+  "SCOREBOARD ", "\n=== PUNTEGGI ATTUALI ===\n", " giocatori):\n", "Intorno a te:\n", "RESYNC\n", "THEMES\n",
+  " tentativi ", " corrette ", " errate ", " scadute ", " mediana ", "ms\n#", "CORRECT", "INCORRECT", "TIMEOUT", "COMPLETED_QUIZ"
+};
+
+/*Function to build the dictionary: the most frequent words of the question banks (weighted by length, so the ones
+  that save the most bytes), then the theme names and the fixed vocabulary. LZ4 prefers the latest positions of a
+  sequence, so the frame vocabulary goes last*/
+std::shared_ptr<const std::string> buildDictionary(const std::vector<Theme> &loaded) {
+  std::string tail;
+  for (const char *word : dictionaryVocabulary) {
+    tail += word;
+  }
+  for (const Theme &theme : loaded) {
+    tail += "\nQuiz " + theme.name + " (";
+  }
+  std::unordered_map<std::string, size_t> weights;
+  for (const Theme &theme : loaded) {
+    for (const Question &question : *theme.bank) {
+      std::istringstream words(question.question + " " + question.answer);
+      std::string word;
+      while (words >> word) {
+        if (word.size() >= DICTIONARY_MIN_WORD) {
+          weights[word] += word.size();
+        }
+      }
+    }
+  }
+  std::vector<std::pair<size_t, std::string>> ranked;
+  for (auto &entry : weights) {
+    ranked.emplace_back(entry.second, entry.first);
+  }
+  std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b) {
+    return a.first != b.first ? a.first > b.first : a.second < b.second;
+  });
+  std::string head;
+  for (const auto &entry : ranked) {
+    if (head.size() + entry.second.size() + 1 + tail.size() > COMPRESSION_DICTIONARY_SIZE) {
+      continue;
+    }
+    head = " " + entry.second + head;
+  }
+  std::string dictionary = head + tail;
+  if (dictionary.size() > COMPRESSION_DICTIONARY_SIZE) {
+    dictionary.erase(0, dictionary.size() - COMPRESSION_DICTIONARY_SIZE);
+  }
+  return std::make_shared<const std::string>(std::move(dictionary));
+}
+
+/*Function to publish a new registry, sessions in the middle of a theme keep the bank they started with.
+  The rankings and score columns of new themes exist before their ids become valid*/
+void installThemes(std::vector<Theme> loaded) {
+  analytics.configure(loaded);
+  std::shared_ptr<const std::string> dictionary = buildDictionary(loaded);
+  {
+    std::unique_lock<std::shared_mutex> lock(playersMutex);
+    while (rankings.size() < loaded.size()) {
+      rankings.emplace_back();
+      scoreTable.addTheme();
+      for (const auto &entry : players) {
+        rankings.back().insert(RankKey(0, entry.second->nickname));
+      }
+    }
+  }
+  std::lock_guard<std::mutex> lock(questionsMutex);
+  themes = std::move(loaded);
+  compressionDictionary = std::move(dictionary);
+  themeCount.store(themes.size(), std::memory_order_release);
+}
+
+/*Function run by the analytics thread: merges the shards and rewrites the stats file now and then*/
+void analyticsThread() {
+  auto lastDump = std::chrono::steady_clock::now();
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ANALYTICS_MERGE_MS));
+    analytics.merge();
+    if (!statsFile.empty() && std::chrono::steady_clock::now() - lastDump >= std::chrono::seconds(ANALYTICS_DUMP_SECONDS)) {
+      analytics.dump(statsFile);
+      lastDump = std::chrono::steady_clock::now();
+    }
+  }
+}
+
+/*Token bucket refilled at `rate` tokens per second up to twice the rate*/
+struct TokenBucket {
+  double tokens{0};
+  std::chrono::steady_clock::time_point last{std::chrono::steady_clock::now()};
+
+  void refill(double rate) {
+    auto now = std::chrono::steady_clock::now();
+    tokens = std::min(2 * rate, tokens + rate * std::chrono::duration<double>(now - last).count());
+    last = now;
+  }
+
+  bool consume(double rate) {
+    if (rate <= 0) {
+      return true;
+    }
+    refill(rate);
+    if (tokens < 1) {
+      return false;
+    }
+    tokens -= 1;
+    return true;
+  }
+};
+
+/*Limits shared by all the connections coming from the same address*/
+struct AddressLimiter {
+  std::mutex limiterMutex;
+  TokenBucket connectionTokens;
+  TokenBucket messageTokens;
+  int activeConnections{0};
+};
+
+/*Transport state of a client: bounded output queue with watermarks and the limiter of its address*/
+struct Connection {
+  /*Owned by the connection, closed by its destructor*/
+  int socket;
+  uint32_t id;
+  std::string address;
+  AddressLimiter *limiter;
+  std::mutex outMutex;
+  std::string outQueue;
+  size_t outOffset{0};
+  bool closing{false};
+  /*False for the sockets of the coroutine server: sends never wait, the session awaits the drain instead*/
+  bool blockingWrites{true};
+  /*Receive buffer reused for every frame, its capacity survives between messages*/
+  std::string inBuffer;
+  /*Bytes read ahead by the non-blocking reader, frames are cut from here*/
+  std::string readBuffer;
+  size_t readOffset{0};
+  /*Coroutine suspended on this socket and timer that enforces the write deadline while it waits.
+  waitMutex guards the handle, the reactor and the answer windows both take it to resume the coroutine*/
+  std::mutex waitMutex;
+  std::coroutine_handle<> waiting;
+  Timer writeTimer;
+  /*Sessions whose answer window expired, their TIMEOUT is sent by the session thread or coroutine once woken.
+  The threaded server sleeps on the socket and on wakeFd (an eventfd), the coroutine server is resumed by the timer*/
+  std::mutex expiryMutex;
+  std::vector<uint32_t> expiredSessions;
+  std::atomic<bool> wakeRequested{false};
+  int wakeFd{-1};
+  /*Set while the idle timer runs, the wake ups of the answer windows do not restart it*/
+  bool idleArmed{false};
+  /*Fired at once to wake the session from a thread that is not the timer's, the admin channel*/
+  Timer wakeTimer;
+  /*Shared memory rings once a local client asked for them, the socket is then only used for doorbells*/
+  SharedChannel *channel{nullptr};
+  /*Every frame starts with a session id once the client asked for MUX*/
+  bool multiplexed{false};
+  /*Set once the client asked for COMPRESS: the dictionary of its compressed frames and the largest frame in both directions*/
+  std::shared_ptr<const std::string> dictionary;
+  size_t maxFrame{BUFFER_SIZE};
+  /*Reaps the connection when the client stays silent too long*/
+  Timer idleTimer;
+
+  Connection(int clientSocket, const std::string &peerAddress, AddressLimiter *addressLimiter);
+  ~Connection();
+};
+
+/*Timer callback, the client has been silent too long: shutting the socket down wakes whoever waits on it*/
+void onConnectionIdle(void *context) {
+  Connection *connection = static_cast<Connection *>(context);
+  logMessage("Reaping idle client on socket: ", connection->socket);
+  shutdown(connection->socket, SHUT_RDWR);
+}
+
+void wakeConnection(Connection &connection);
+
+/*Timer callback, the sessions queued on expiredSessions by another thread are served*/
+void onConnectionWake(void *context) {
+  wakeConnection(*static_cast<Connection *>(context));
+}
+
+std::mutex limitersMutex;
+std::unordered_map<std::string, AddressLimiter> limiters;
+/*Live connections, used at shutdown without touching playersMutex*/
+std::mutex connectionsMutex;
+std::unordered_map<int, Connection *> connections;
+std::atomic<uint32_t> nextConnectionId{1};
+
+Connection::Connection(int clientSocket, const std::string &peerAddress, AddressLimiter *addressLimiter)
+  : socket(clientSocket), id(nextConnectionId++), address(peerAddress), limiter(addressLimiter) {
+  if (recorder.enabled) {
+    recorder.record(CAPTURE_OPEN, id, 0, nullptr);
+  }
+  inBuffer.reserve(BUFFER_SIZE);
+  outQueue.reserve(2 * BUFFER_SIZE);
+  idleTimer.callback = onConnectionIdle;
+  idleTimer.context = this;
+  wakeTimer.callback = onConnectionWake;
+  wakeTimer.context = this;
+  std::lock_guard<std::mutex> lock(connectionsMutex);
+  connections[socket] = this;
+}
+
+Connection::~Connection() {
+  timerWheel.cancel(idleTimer);
+  timerWheel.cancel(wakeTimer);
+  if (recorder.enabled) {
+    recorder.record(CAPTURE_CLOSE, id, 0, nullptr);
+  }
+  if (channel != nullptr) {
+    munmap(channel, sizeof(SharedChannel));
+  }
+  if (wakeFd >= 0) {
+    close(wakeFd);
+  }
+  {
+    /*Closed only once out of the map: accept may reuse the number at once, and the new entry must not be erased nor its socket shut*/
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    connections.erase(socket);
+    close(socket);
+  }
+  std::lock_guard<std::mutex> lock(limitersMutex);
+  bool forget = false;
+  {
+    std::lock_guard<std::mutex> limiterLock(limiter->limiterMutex);
+    /*The address is kept while its bucket is not full, otherwise reconnecting would reset the rate*/
+    limiter->connectionTokens.refill(connectionRate);
+    forget = --limiter->activeConnections == 0 && limiter->connectionTokens.tokens >= 2 * connectionRate;
+  }
+  if (forget) {
+    limiters.erase(address);
+  }
+}
+
+/*Function to admit a new connection from an address, nullptr when the address is over its limits*/
+AddressLimiter *admitConnection(const std::string &address) {
+  std::lock_guard<std::mutex> lock(limitersMutex);
+  auto [entry, created] = limiters.try_emplace(address);
+  AddressLimiter &limiter = entry->second;
+  std::lock_guard<std::mutex> limiterLock(limiter.limiterMutex);
+  if (created) {
+    limiter.connectionTokens.tokens = 2 * connectionRate;
+    limiter.messageTokens.tokens = 2 * messageRate;
+  }
+  if ((maxConnectionsPerIp > 0 && limiter.activeConnections >= maxConnectionsPerIp) ||
+      !limiter.connectionTokens.consume(connectionRate)) {
+    return nullptr;
+  }
+  ++limiter.activeConnections;
+  return &limiter;
+}
+
+/*Function to drop a client that does not keep up, the blocked receive of its handler wakes up and cleans up*/
+void disconnectConnection(Connection &connection, const std::string &reason) {
+  if (!connection.closing) {
+    connection.closing = true;
+    logMessage("Disconnecting ", connection.address, ": ", reason);
+    shutdown(connection.socket, SHUT_RDWR);
+  }
+}
+
+/*Function to wake the client if it sleeps on the rings*/
+void ringDoorbell(Connection &connection) {
+  if (connection.channel->clientWaiting.exchange(0) != 0) {
+    char bell = 0;
+    send(connection.socket, &bell, sizeof(bell), MSG_DONTWAIT | MSG_NOSIGNAL);
+  }
+}
+
+/*Function to consume the doorbells of the client, false once it closed the socket*/
+bool drainDoorbell(Connection &connection) {
+  char bells[64];
+  while (true) {
+    ssize_t bytes = recv(connection.socket, bells, sizeof(bells), MSG_DONTWAIT);
+    if (bytes > 0 || (bytes < 0 && errno == EINTR)) {
+      continue;
+    }
+    return bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+}
+
+/*Function to write without blocking on the socket or on the shared ring, same result convention as send*/
+ssize_t transportSend(Connection &connection, const char *data, size_t length) {
+  if (connection.channel == nullptr) {
+    return send(connection.socket, data, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+  }
+  SharedChannel &channel = *connection.channel;
+  size_t written = channel.toClient.write(data, length);
+  if (written == 0) {
+    if (!drainDoorbell(connection)) {
+      errno = EPIPE;
+      return -1;
+    }
+    /*Ring full: ask for a doorbell, then look again in case the client drained it meanwhile*/
+    channel.serverWaiting = 1;
+    written = channel.toClient.write(data, length);
+    if (written == 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+    channel.serverWaiting = 0;
+  }
+  ringDoorbell(connection);
+  return written;
+}
+
+/*Function to read without blocking from the socket or from the shared ring, same result convention as recv*/
+ssize_t transportReceive(Connection &connection, char *data, size_t length) {
+  if (connection.channel == nullptr) {
+    return recv(connection.socket, data, length, MSG_DONTWAIT);
+  }
+  SharedChannel &channel = *connection.channel;
+  size_t received = channel.toServer.read(data, length);
+  if (received == 0) {
+    if (!drainDoorbell(connection)) {
+      return 0;
+    }
+    channel.serverWaiting = 1;
+    received = channel.toServer.read(data, length);
+    if (received == 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+    channel.serverWaiting = 0;
+  }
+  ringDoorbell(connection);
+  return received;
+}
+
+/*Event to wait for on the socket: with the rings every wake up, for reading or for writing, is a doorbell*/
+short transportEvents(const Connection &connection, short events) {
+  return (connection.channel != nullptr) ? POLLIN : events;
+}
+
+/*Function to write as much of the output queue as the socket accepts without blocking, caller holds outMutex*/
+bool flushOutput(Connection &connection) {
+  while (connection.outOffset < connection.outQueue.size()) {
+    ssize_t sent = transportSend(connection, connection.outQueue.data() + connection.outOffset,
+        connection.outQueue.size() - connection.outOffset);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return true;
+      }
+      logMessage("Error sending message: ", errno);
+      return false;
+    }
+    connection.outOffset += sent;
+  }
+  connection.outQueue.clear();
+  connection.outOffset = 0;
+  return true;
+}
+
+/*Function to wait until at most `limit` bytes are queued, false if the write deadline expires first, caller holds outMutex*/
+bool waitOutput(Connection &connection, size_t limit) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(WRITE_DEADLINE_MS);
+  while (true) {
+    if (!flushOutput(connection)) {
+      return false;
+    }
+    if (connection.outQueue.size() - connection.outOffset <= limit) {
+      return true;
+    }
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    if (remaining <= 0) {
+      logMessage("Write deadline expired for ", connection.address);
+      return false;
+    }
+    pollfd writable{connection.socket, transportEvents(connection, POLLOUT), 0};
+    poll(&writable, 1, static_cast<int>(remaining));
+  }
+}
+
+/*Function used at shutdown: queues the message and tries a single non-blocking write, never waits for the client.
+  On a multiplexed connection the message carries session id 0, meant for every session*/
+void sendNow(Connection &connection, std::string_view message) {
+  std::unique_lock<std::mutex> lock(connection.outMutex, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return;
+  }
+  size_t header = connection.multiplexed ? sizeof(uint32_t) : 0;
+  uint32_t sessionId = 0;
+  uint32_t messageLength = htonl(header + message.size());
+  connection.outQueue.append(reinterpret_cast<const char *>(&messageLength), sizeof(messageLength));
+  connection.outQueue.append(reinterpret_cast<const char *>(&sessionId), header);
+  connection.outQueue.append(message);
+  flushOutput(connection);
+}
+
+/*After client acepting to finish the quiz, the server will send a message to the client to close the connection and remove the client data from the server.
+  Takes every player that left at once, a multiplexed connection going away costs one pass over players whatever its number of sessions*/
+void removeClientData(std::vector<Player *> &departed) {
+  departed.erase(std::remove(departed.begin(), departed.end(), nullptr), departed.end());
+  if (departed.empty()) {
+    return;
+  }
+  std::sort(departed.begin(), departed.end());
+  {
+    std::unique_lock<std::shared_mutex> lock(playersMutex);
+    players.erase(std::remove_if(players.begin(), players.end(),
+          [&departed](const std::pair<int, Player *> &player) {
+          return std::binary_search(departed.begin(), departed.end(), player.second);
+          }), players.end());
+    for (Player *player : departed) {
+      logMessage("Removing data for client: ", player->nickname);
+      removeFromRankings(*player);
+      scoreTable.release(player->slot);
+      playersByName.erase(player->nickname.view());
+      poolDelete(player);
+    }
+  }
+  printScoreboard();
+}
+
+/*Function to send messages to the client, queues the length and the message and writes them without blocking.
+  Above the high watermark it waits for the client to drain below the low one, a client over the queue limit or the write deadline is dropped*/
+bool secureSend(Connection &connection, std::string_view message, uint32_t session = 0) {
+  try {
+    std::lock_guard<std::mutex> lock(connection.outMutex);
+    if (connection.closing) {
+      return false;
+    }
+    if (connection.outOffset > 0) {
+      connection.outQueue.erase(0, connection.outOffset);
+      connection.outOffset = 0;
+    }
+    size_t header = connection.multiplexed ? sizeof(session) : 0;
+    uint32_t sessionId = htonl(session);
+    /*Large frames go compressed once negotiated, the session id is compressed with the message*/
+    thread_local std::string plain, packed;
+    bool compressed = false;
+    if (connection.dictionary != nullptr && header + message.size() >= COMPRESSION_MIN_SIZE) {
+      plain.assign(reinterpret_cast<const char *>(&sessionId), header);
+      plain.append(message);
+      compressed = compressFrame(plain, *connection.dictionary, packed);
+    }
+    size_t payload = compressed ? packed.size() : header + message.size();
+    if (connection.outQueue.size() + sizeof(uint32_t) + payload > OUTPUT_QUEUE_LIMIT) {
+      disconnectConnection(connection, "output queue limit exceeded");
+      return false;
+    }
+    uint32_t messageLength = htonl(payload | (compressed ? FRAME_COMPRESSED_FLAG : 0));
+    connection.outQueue.append(reinterpret_cast<const char *>(&messageLength), sizeof(messageLength));
+    if (compressed) {
+      connection.outQueue.append(packed);
+    } else {
+      connection.outQueue.append(reinterpret_cast<const char *>(&sessionId), header);
+      connection.outQueue.append(message);
+    }
+    if (!flushOutput(connection)) {
+      disconnectConnection(connection, "send failed");
+      return false;
+    }
+    if (connection.blockingWrites && connection.outQueue.size() - connection.outOffset > OUTPUT_HIGH_WATERMARK &&
+        !waitOutput(connection, OUTPUT_LOW_WATERMARK)) {
+      disconnectConnection(connection, "client too slow");
+      return false;
+    }
+    if (recorder.enabled) {
+      recorder.record(CAPTURE_OUTBOUND, connection.id, message.size(), nullptr);
+    }
+    if (compressed) {
+      logDebug("Sent message of size: ", message.size(), " compressed to ", payload);
+    } else {
+      logDebug("Sent message of size: ", message.size());
+    }
+    return true;
+  } catch (const std::exception &e) {
+    logMessage("Exception in secureSend: ", e.what());
+    return false;
+  }
+}
+
+/*Largest frame a client may send, the session id of a multiplexed frame comes on top of the message*/
+size_t frameLimit(const Connection &connection) {
+  return connection.maxFrame + (connection.multiplexed ? sizeof(uint32_t) : 0);
+}
+
+/*Largest message the server builds for this connection, BUFFER_SIZE unless COMPRESS negotiated more*/
+size_t messageLimit(const Connection &connection) {
+  return connection.maxFrame;
+}
+
+/*Function to restore a frame sent with FRAME_COMPRESSED_FLAG, false drops the client*/
+bool unpackFrame(Connection &connection, std::string_view payload, std::string &message) {
+  if (connection.dictionary == nullptr) {
+    logMessage("Compressed frame before COMPRESS from ", connection.address);
+    return false;
+  }
+  if (!decompressFrame(payload, *connection.dictionary, frameLimit(connection), message)) {
+    logMessage("Malformed compressed frame from ", connection.address);
+    return false;
+  }
+  return true;
+}
+
+/*Function called for every complete frame: rate limit of the address, recorder and log. False drops the client*/
+bool acceptFrame(Connection &connection, const std::string &message) {
+  /*The frames of a multiplexed connection are charged by its multiplexer, to a budget sized by its sessions*/
+  bool allowed = true;
+  if (!connection.multiplexed) {
+    std::lock_guard<std::mutex> lock(connection.limiter->limiterMutex);
+    allowed = connection.limiter->messageTokens.consume(messageRate);
+  }
+  if (!allowed) {
+    std::lock_guard<std::mutex> lock(connection.outMutex);
+    disconnectConnection(connection, "message rate exceeded");
+    return false;
+  }
+  if (recorder.enabled) {
+    recorder.record(CAPTURE_INBOUND, connection.id, message.size(), message.data());
+  }
+  logDebug("Received message of size: ", message.size());
+  logDebug("Received: ", message);
+  return true;
+}
+
+/*Function to receive exactly `length` bytes, a frame can arrive split over several segments. Same result convention as recv*/
+ssize_t receiveAll(int clientSocket, void *data, size_t length) {
+  size_t received = 0;
+  while (received < length) {
+    ssize_t bytes = recv(clientSocket, static_cast<char *>(data) + received, length - received, 0);
+    if (bytes < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes <= 0) {
+      return bytes;
+    }
+    received += bytes;
+  }
+  return received;
+}
+
+/*Function to read what the non-blocking socket or ring has and cut the next frame out of the read buffer.
+  Returns 1 with a frame in `message`, 0 when the socket has nothing more for now, -1 when the connection is over*/
+int readFrame(Connection &connection, std::string &message) {
+  while (true) {
+    size_t available = connection.readBuffer.size() - connection.readOffset;
+    if (available >= sizeof(uint32_t)) {
+      uint32_t messageLength = 0;
+      std::memcpy(&messageLength, connection.readBuffer.data() + connection.readOffset, sizeof(messageLength));
+      messageLength = ntohl(messageLength);
+      bool compressed = messageLength & FRAME_COMPRESSED_FLAG;
+      messageLength &= ~FRAME_COMPRESSED_FLAG;
+      if (messageLength > frameLimit(connection)) {
+        logMessage("Message too large");
+        return -1;
+      }
+      if (available >= sizeof(uint32_t) + messageLength) {
+        std::string_view payload(connection.readBuffer.data() + connection.readOffset + sizeof(uint32_t), messageLength);
+        if (compressed) {
+          if (!unpackFrame(connection, payload, message)) {
+            return -1;
+          }
+        } else {
+          message.assign(payload);
+        }
+        connection.readOffset += sizeof(uint32_t) + messageLength;
+        if (connection.readOffset == connection.readBuffer.size()) {
+          connection.readBuffer.clear();
+          connection.readOffset = 0;
+        }
+        return acceptFrame(connection, message) ? 1 : -1;
+      }
+    }
+    if (connection.readOffset > 0) {
+      connection.readBuffer.erase(0, connection.readOffset);
+      connection.readOffset = 0;
+    }
+    char chunk[BUFFER_SIZE];
+    ssize_t bytes = transportReceive(connection, chunk, sizeof(chunk));
+    if (bytes < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return 0;
+    }
+    if (bytes <= 0) {
+      logMessage("Client disconnected: ", connection.address);
+      return -1;
+    }
+    connection.readBuffer.append(chunk, bytes);
+  }
+}
+
+/*Function to receive messages from the client, first receives the length of the message and then the message itself*/
+bool secureReceive(Connection &connection, std::string &message) {
+  int clientSocket = connection.socket;
+  try {
+    /*Everything queued must reach the client before waiting for its reply*/
+    {
+      std::lock_guard<std::mutex> lock(connection.outMutex);
+      if (!waitOutput(connection, 0)) {
+        disconnectConnection(connection, "client too slow");
+        return false;
+      }
+    }
+    /*Frames from the shared ring are cut by the non-blocking reader, sleeping on the doorbell in between*/
+    if (connection.channel != nullptr) {
+      int status;
+      while ((status = readFrame(connection, message)) == 0) {
+        pollfd readable{clientSocket, POLLIN, 0};
+        poll(&readable, 1, -1);
+      }
+      return status > 0;
+    }
+    uint32_t messageLength = 0;
+    ssize_t bytesReceived = receiveAll(clientSocket, &messageLength, sizeof(messageLength));
+    if (bytesReceived <= 0) {
+      if (bytesReceived == 0) {
+        struct sockaddr_in peerAddr;
+        socklen_t peerAddrLen = sizeof(peerAddr);
+        if (getpeername(clientSocket, (struct sockaddr *)&peerAddr, &peerAddrLen) == 0) {
+          char clientIP[INET_ADDRSTRLEN];
+          inet_ntop(AF_INET, &peerAddr.sin_addr, clientIP, sizeof(clientIP));
+          logMessage("Client disconnected: ", clientIP, ":", ntohs(peerAddr.sin_port));
+          std::cout << "Client disconnected: " << clientIP << ":" << ntohs(peerAddr.sin_port) << std::endl;
+        } else {
+          logMessage("Client disconnected (error getting address)");
+        }
+      } else {
+        logMessage("Error receiving message length");
+      }
+      return false;
+    }
+    messageLength = ntohl(messageLength);
+    bool compressed = messageLength & FRAME_COMPRESSED_FLAG;
+    messageLength &= ~FRAME_COMPRESSED_FLAG;
+    if (messageLength > frameLimit(connection)) {
+      logMessage("Message too large");
+      return false;
+    }
+    /*Reading straight into the caller's buffer, no allocation once its capacity reaches BUFFER_SIZE.
+      A compressed payload goes to a side buffer and is restored into the caller's*/
+    thread_local std::string packed;
+    std::string &target = compressed ? packed : message;
+    target.resize(messageLength);
+    bytesReceived = receiveAll(clientSocket, target.data(), messageLength);
+    if (bytesReceived <= 0) {
+      if (bytesReceived == 0) {
+        struct sockaddr_in peerAddr;
+        socklen_t peerAddrLen = sizeof(peerAddr);
+        if (getpeername(clientSocket, (struct sockaddr *)&peerAddr, &peerAddrLen) == 0) {
+          char clientIP[INET_ADDRSTRLEN];
+          inet_ntop(AF_INET, &peerAddr.sin_addr, clientIP, sizeof(clientIP));
+          logMessage("Client disconnected: ", clientIP, ":", ntohs(peerAddr.sin_port));
+          std::cout << "Client disconnected: " << clientIP << ":" << ntohs(peerAddr.sin_port) << std::endl;
+        } else {
+          logMessage("Client disconnected (error getting address)");
+        }
+      } else {
+        logMessage("Error receiving message");
+      }
+      return false;
+    }
+    if (compressed && !unpackFrame(connection, packed, message)) {
+      return false;
+    }
+    return acceptFrame(connection, message);
+  } catch (const std::exception &e) {
+    logMessage("Exception in secureReceive: ", e.what());
+    return false;
+  }
+}
+
+/*Function to append the page of a theme ranking centered on the player, caller holds playersMutex*/
+bool appendPlayerPage(std::string &out, int theme, const Player &player, size_t pageSize, size_t questionCount,
+                      size_t limit = BUFFER_SIZE) {
+  int score = scoreTable.score(player.slot, theme);
+  size_t rank = rankings[theme - 1].order_of_key(RankKey(-score, player.nickname));
+  size_t first = (rank > pageSize / 2) ? rank - pageSize / 2 : 0;
+  return appendRanking(out, theme, first, pageSize, questionCount, limit);
+}
+
+/*Function to send the scoreboard to the client, only the top and the page around the player so it always fits a frame.
+  The theme being played comes first, the others follow while they fit and can be asked with SCOREBOARD TOP*/
+void sendScoreboard(Connection &connection, const Player *player, uint32_t session, int currentTheme) {
+  try {
+    std::vector<std::pair<std::string, size_t>> themeInfo;
+    {
+      std::lock_guard<std::mutex> lock(questionsMutex);
+      for (const Theme &theme : themes) {
+        themeInfo.emplace_back(theme.name, theme.bank->size());
+      }
+    }
+    std::vector<int> order;
+    if (currentTheme >= 1 && static_cast<size_t>(currentTheme) <= themeInfo.size()) {
+      order.push_back(currentTheme);
+    }
+    for (int theme = 1; static_cast<size_t>(theme) <= themeInfo.size(); ++theme) {
+      if (theme != currentTheme) {
+        order.push_back(theme);
+      }
+    }
+    std::string scoreboard;
+    size_t limit = messageLimit(connection);
+    {
+      std::shared_lock<std::shared_mutex> lock(playersMutex);
+      appendLine(scoreboard, "SCOREBOARD " + std::to_string(scoreboardVersion), limit);
+      appendLine(scoreboard, "\n=== PUNTEGGI ATTUALI ===", limit);
+      for (int theme : order) {
+        size_t questionCount = themeInfo[theme - 1].second;
+        if (static_cast<size_t>(theme) > rankings.size() ||
+            !appendLine(scoreboard, "\nQuiz " + themeInfo[theme - 1].first + " (" +
+              std::to_string(rankings[theme - 1].size()) + " giocatori):", limit - 64)) {
+          break;
+        }
+        appendRanking(scoreboard, theme, 0, SCOREBOARD_SUMMARY, questionCount, limit);
+        if (player != nullptr) {
+          appendLine(scoreboard, "Intorno a te:", limit);
+          appendPlayerPage(scoreboard, theme, *player, SCOREBOARD_SUMMARY, questionCount, limit);
+        }
+      }
+    }
+    secureSend(connection, scoreboard, session);
+  } catch (const std::exception &e) {
+    logMessage("Exception in sendScoreboard: ", e.what());
+  }
+}
+
+/*Function to answer "SCOREBOARD TOP <theme> <k>", "SCOREBOARD PAGE <theme> <k>" and "SCOREBOARD SINCE <version>"*/
+void sendScoreboardRequest(Connection &connection, const Player *player, uint32_t session, const std::string &request) {
+  try {
+    std::istringstream in(request);
+    std::string command, kind;
+    long long first = 0, second = SCOREBOARD_PAGE;
+    in >> command >> kind >> first;
+    if (!(in >> second)) {
+      second = SCOREBOARD_PAGE;
+    }
+    std::string body;
+    uint64_t version = 0;
+    /*A connection with larger frames gets proportionally longer pages*/
+    size_t limit = messageLimit(connection);
+    long long pageLimit = SCOREBOARD_PAGE * static_cast<long long>(limit / BUFFER_SIZE);
+    {
+      std::shared_lock<std::shared_mutex> lock(playersMutex);
+      version = scoreboardVersion;
+      if (kind == "TOP" || kind == "PAGE") {
+        int theme = static_cast<int>(first);
+        size_t count = static_cast<size_t>(std::clamp<long long>(second, 1, pageLimit));
+        if (!validTheme(theme)) {
+          body = "INVALID_THEME\n";
+        } else {
+          size_t questionCount = bankSize(theme);
+          if (kind == "TOP") {
+            appendRanking(body, theme, 0, count, questionCount, limit);
+          } else if (player != nullptr) {
+            appendPlayerPage(body, theme, *player, count, questionCount, limit);
+          }
+        }
+      } else if (kind == "SINCE") {
+        uint64_t since = std::min<uint64_t>(first > 0 ? static_cast<uint64_t>(first) : 0, scoreboardVersion);
+        if (scoreboardVersion - since > SCOREBOARD_LOG_SIZE) {
+          /*Too old for the ring, the client has to start again from the top*/
+          appendLine(body, "RESYNC");
+          for (int theme = 1; validTheme(theme) && static_cast<size_t>(theme) <= rankings.size(); ++theme) {
+            if (!appendLine(body, "# " + std::to_string(theme), limit - 32) ||
+                !appendRanking(body, theme, 0, SCOREBOARD_SUMMARY, bankSize(theme), limit)) {
+              break;
+            }
+          }
+        } else {
+          /*Leave room for the header, the reported version is the last change that fits*/
+          for (version = since; version < scoreboardVersion; ++version) {
+            const ScoreChange &change = scoreChanges[version % SCOREBOARD_LOG_SIZE];
+            std::string line = (change.theme == 0) ? "- " + change.nickname.str() : ((change.theme < 0) ? "+ " + change.nickname.str() :
+              std::to_string(change.theme) + " " + change.nickname.str() + ": " + std::to_string(change.score));
+            if (!appendLine(body, line, limit - 32)) {
+              break;
+            }
+          }
+        }
+      } else {
+        body = "INVALID_REQUEST\n";
+      }
+    }
+    secureSend(connection, "SCOREBOARD " + std::to_string(version) + "\n" + body, session);
+  } catch (const std::exception &e) {
+    logMessage("Exception in sendScoreboardRequest: ", e.what());
+  }
+}
+
+/*Function to answer "STATS <theme> [first] [count]" with the merged analytics of those questions*/
+void sendStatsRequest(Connection &connection, uint32_t session, const std::string &request) {
+  std::istringstream in(request);
+  std::string command;
+  int theme = 0;
+  long long first = 1, count = SCOREBOARD_PAGE, value = 0;
+  in >> command >> theme;
+  if (in >> value) {
+    first = value;
+    if (in >> value) {
+      count = value;
+    }
+  }
+  if (!validTheme(theme)) {
+    secureSend(connection, "INVALID_THEME", session);
+    return;
+  }
+  std::string body = "STATS " + std::to_string(theme) + "\n";
+  analytics.appendStats(body, theme, static_cast<size_t>(std::max(first, 1LL) - 1),
+      static_cast<size_t>(std::max(count, 0LL)), messageLimit(connection));
+  secureSend(connection, body, session);
+}
+
+/*Function to answer "THEMES" with one line per theme: id, number of questions and name*/
+void sendThemes(Connection &connection, uint32_t session) {
+  std::string body = "THEMES\n";
+  {
+    std::lock_guard<std::mutex> lock(questionsMutex);
+    for (size_t index = 0; index < themes.size(); ++index) {
+      if (!appendLine(body, std::to_string(index + 1) + " " + std::to_string(themes[index].bank->size()) + " " +
+            themes[index].name, messageLimit(connection))) {
+        break;
+      }
+    }
+  }
+  secureSend(connection, body, session);
+}
+
+/*Function to move a local client to shared memory, the region is a memfd passed with SCM_RIGHTS next to the SHM_READY frame*/
+bool openSharedChannel(Connection &connection) {
+  int domain = 0;
+  socklen_t domainLength = sizeof(domain);
+  if (connection.channel != nullptr || getsockopt(connection.socket, SOL_SOCKET, SO_DOMAIN, &domain, &domainLength) < 0 ||
+      domain != AF_UNIX) {
+    logMessage("Shared memory refused for ", connection.address);
+    return false;
+  }
+  int memory = memfd_create("trivia-ring", MFD_CLOEXEC);
+  if (memory < 0 || ftruncate(memory, sizeof(SharedChannel)) < 0) {
+    logMessage("Error creating shared memory: ", errno);
+    if (memory >= 0) {
+      close(memory);
+    }
+    return false;
+  }
+  void *region = mmap(nullptr, sizeof(SharedChannel), PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+  if (region == MAP_FAILED) {
+    logMessage("Error mapping shared memory: ", errno);
+    close(memory);
+    return false;
+  }
+  SharedChannel *channel = new (region) SharedChannel();
+
+  std::string_view reply = "SHM_READY";
+  char frame[sizeof(uint32_t) + 16];
+  uint32_t messageLength = htonl(reply.size());
+  std::memcpy(frame, &messageLength, sizeof(messageLength));
+  std::memcpy(frame + sizeof(messageLength), reply.data(), reply.size());
+  iovec payload{frame, sizeof(messageLength) + reply.size()};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr header{};
+  header.msg_iov = &payload;
+  header.msg_iovlen = 1;
+  header.msg_control = control;
+  header.msg_controllen = sizeof(control);
+  cmsghdr *rights = CMSG_FIRSTHDR(&header);
+  rights->cmsg_level = SOL_SOCKET;
+  rights->cmsg_type = SCM_RIGHTS;
+  rights->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(rights), &memory, sizeof(int));
+
+  /*Nothing was queued before the negotiation, so the reply goes out alone and whole*/
+  std::lock_guard<std::mutex> lock(connection.outMutex);
+  ssize_t sent = sendmsg(connection.socket, &header, MSG_NOSIGNAL);
+  close(memory);
+  if (sent != static_cast<ssize_t>(payload.iov_len)) {
+    logMessage("Error sending shared memory to ", connection.address);
+    munmap(region, sizeof(SharedChannel));
+    return false;
+  }
+  connection.channel = channel;
+  logMessage("Client on socket ", connection.socket, " moved to shared memory");
+  return true;
+}
+
+/*State of the question a session is waiting an answer for*/
+enum QuestionState { QUESTION_IDLE, QUESTION_PENDING, QUESTION_EXPIRED };
+
+/*Protocol states of a session, each one is the message the session waits for next*/
+enum SessionState { AWAIT_START, AWAIT_NICKNAME, AWAIT_THEME, AWAIT_ANSWER, AWAIT_FINISH, SESSION_CLOSED };
+
+/*Quiz protocol as an explicit state machine: it is fed one client frame at a time and queues its replies on the connection.
+  It never waits by itself, so the same object is driven by a thread (handleClient) or by a coroutine (runSession)*/
+class QuizSession {
+  public:
+    Connection &connection;
+    /*Id carried by the frames of this session on a multiplexed connection, 0 otherwise*/
+    uint32_t id;
+    std::atomic<int> questionState{QUESTION_IDLE};
+    Timer questionTimer;
+
+    QuizSession(Connection &clientConnection, uint32_t sessionId = 0);
+    ~QuizSession() {
+      timerWheel.cancel(questionTimer);
+    }
+
+    /*Function to handle one frame, false when the session is over and the connection has to be closed*/
+    bool onMessage(const std::string &message) {
+      if (player != nullptr && player->kicked) {
+        reply("KICKED");
+        return close();
+      }
+      /*Analytics and the theme list can be asked at any point of a started session, the state does not move*/
+      if (state != AWAIT_START && message.rfind("STATS ", 0) == 0) {
+        sendStatsRequest(connection, id, message);
+        return true;
+      }
+      if (state != AWAIT_START && message == "THEMES") {
+        sendThemes(connection, id);
+        return true;
+      }
+      switch (state) {
+        case AWAIT_START:
+          return onStart(message);
+        case AWAIT_NICKNAME:
+          return onNickname(message);
+        case AWAIT_THEME:
+          return onTheme(message);
+        case AWAIT_ANSWER:
+          return onAnswer(message);
+        case AWAIT_FINISH:
+          return onFinish(message);
+        case SESSION_CLOSED:
+          break;
+      }
+      return false;
+    }
+
+    /*Function called once woken for an expired answer window: TIMEOUT and the next question go out without waiting
+      for the client. False when the session is over. A window already settled by an answer is ignored, a kicked
+      player is sent away*/
+    bool onExpired() {
+      if (player != nullptr && player->kicked) {
+        reply("KICKED");
+        return close();
+      }
+      int expired = QUESTION_EXPIRED;
+      if (state != AWAIT_ANSWER || !questionState.compare_exchange_strong(expired, QUESTION_IDLE)) {
+        return true;
+      }
+      return sendTimeout("Answer window expired, sent TIMEOUT");
+    }
+
+    SessionState currentState() const { return state; }
+    Player *currentPlayer() const { return player; }
+
+  private:
+    SessionState state{AWAIT_START};
+    Player *player{nullptr};
+    int theme{0};
+    size_t questionIndex{0};
+    QuestionBank bank;
+    int windowSeconds{ANSWER_WINDOW_SECONDS};
+    std::chrono::steady_clock::time_point questionSentAt;
+
+    const std::vector<Question> &questions() const {
+      return *bank;
+    }
+
+    bool close() {
+      state = SESSION_CLOSED;
+      return false;
+    }
+
+    bool reply(std::string_view message) {
+      return secureSend(connection, message, id);
+    }
+
+    bool onStart(const std::string &message) {
+      /*Transport negotiation of a local client, the quiz starts with the next frame*/
+      if (message == "SHM") {
+        return openSharedChannel(connection) ? true : close();
+      }
+      if (message != "START") {
+        return close();
+      }
+      state = AWAIT_NICKNAME;
+      return true;
+    }
+
+    bool onNickname(const std::string &message) {
+      if (message.empty() || message.size() > MAX_NICKNAME || message.find('\n') != std::string::npos) {
+        reply("INVALID_NICKNAME");
+        return true;
+      }
+      bool nicknameTaken = false;
+      {
+        /*Checked and taken under the same hold, two sessions can not both get a nickname*/
+        std::unique_lock<std::shared_mutex> lock(playersMutex);
+        nicknameTaken = playersByName.count(message) != 0;
+        if (!nicknameTaken) {
+          player = poolNew<Player>(message);
+          player->slot = scoreTable.acquire(player);
+          player->socket = connection.socket;
+          player->session = id;
+          players.emplace_back(connection.socket, player);
+          playersByName.emplace(player->nickname.view(), player);
+          addToRankings(*player);
+        }
+      }
+      if (nicknameTaken) {
+        reply("NICKNAME_ALREADY_USED");
+      } else {
+        reply("OK");
+        printScoreboard();
+        state = AWAIT_THEME;
+      }
+      return true;
+    }
+
+    bool onTheme(const std::string &message) {
+      int selected;
+      try {
+        selected = std::stoi(message);
+      } catch (const std::exception &e) {
+        logMessage("Invalid input for theme selection: ", message);
+        reply("INVALID_THEME");
+        return true;
+      }
+      if (!validTheme(selected)) {
+        reply("INVALID_THEME");
+        return true;
+      }
+      bool isCompleted = false;
+      {
+        std::shared_lock<std::shared_mutex> lock(playersMutex);
+        isCompleted = scoreTable.completed(player->slot, selected);
+      }
+      if (isCompleted) {
+        logMessage("Player ", player->nickname, " attempted to repeat completed theme: ", selected);
+        reply("ALREADY_COMPLETED");
+        return true;
+      }
+      theme = selected;
+      bank = questionBank(theme);
+      windowSeconds = answerWindow(theme);
+      questionIndex = 0;
+      reply("OK");
+      state = AWAIT_ANSWER;
+      return sendQuestion(true);
+    }
+
+    /*Function to send the current question, its answer window starts only the first time it is sent*/
+    bool sendQuestion(bool armWindow) {
+      if (questionIndex >= questions().size()) {
+        return finishTheme();
+      }
+      const Question &question = questions()[questionIndex];
+      reply(question.question);
+      logDebug("Sent question: ", question.question);
+      if (armWindow) {
+        questionSentAt = std::chrono::steady_clock::now();
+        questionState = QUESTION_PENDING;
+        timerWheel.arm(questionTimer, std::chrono::seconds(windowSeconds));
+      }
+      return true;
+    }
+
+    void recordOutcome(QuestionOutcome outcome) {
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - questionSentAt);
+      analytics.record(questions()[questionIndex], outcome, elapsed.count());
+    }
+
+    bool nextQuestion() {
+      ++questionIndex;
+      return sendQuestion(true);
+    }
+
+    bool sendTimeout(const char *reason) {
+      recordOutcome(OUTCOME_TIMEOUT);
+      reply("TIMEOUT");
+      logMessage(reason);
+      printScoreboard();
+      return nextQuestion();
+    }
+
+    bool onAnswer(const std::string &message) {
+      /*Showing the scoreboard sends the question again but does not restart its window.
+        A window that expired before the session was woken for it gets its TIMEOUT here, after the scoreboard*/
+      if (message == "show score" || message.rfind("SCOREBOARD ", 0) == 0) {
+        if (message == "show score") {
+          sendScoreboard(connection, player, id, theme);
+          logDebug("Sent scoreboard");
+        } else {
+          sendScoreboardRequest(connection, player, id, message);
+        }
+        int expired = QUESTION_EXPIRED;
+        if (questionState.compare_exchange_strong(expired, QUESTION_IDLE)) {
+          return sendTimeout("Answer window expired during a scoreboard request, sent TIMEOUT");
+        }
+        return sendQuestion(false);
+      }
+      if (message == "endquiz") {
+        reply("Quiz terminated.");
+        logMessage("Quiz terminated.");
+        return close();
+      }
+      /*Settles the window either way, a wake up still queued for it finds it idle and is ignored*/
+      bool inTime = questionState.exchange(QUESTION_IDLE) == QUESTION_PENDING;
+      timerWheel.cancel(questionTimer);
+      if (!inTime) {
+        return sendTimeout("Answer arrived after the window, sent TIMEOUT");
+      }
+      bool correct = message == questions()[questionIndex].answer;
+      recordOutcome(correct ? OUTCOME_CORRECT : OUTCOME_INCORRECT);
+      if (correct) {
+        std::unique_lock<std::shared_mutex> lock(playersMutex);
+        int score = scoreTable.addPoint(player->slot, theme);
+        updateRanking(theme, player->nickname, score - 1, score);
+        logMessage("Player ", player->nickname, " scored a point in theme ", theme, ", now has: ", score);
+      }
+      reply(correct ? "CORRECT" : "INCORRECT");
+      printScoreboard();
+      return nextQuestion();
+    }
+
+    bool finishTheme() {
+      bool allCompleted = false;
+      {
+        std::unique_lock<std::shared_mutex> lock(playersMutex);
+        scoreTable.complete(player->slot, theme);
+        logMessage("Player ", player->nickname, " completed theme ", theme, " with score: ",
+            scoreTable.score(player->slot, theme), "/", bank->size());
+        allCompleted = scoreTable.completedAll(player->slot);
+      }
+      printScoreboard();
+      if (!allCompleted) {
+        logMessage("Player ", player->nickname, " completed one quiz, can continue with the others");
+        reply("COMPLETED_QUIZ");
+        state = AWAIT_THEME;
+        return true;
+      }
+      /*The name dates from the two fixed themes, it now means every theme of the registry*/
+      reply("BOTH_QUIZZES_COMPLETED");
+      logMessage("Player ", player->nickname, " completed every quiz");
+      state = AWAIT_FINISH;
+      return true;
+    }
+
+    bool onFinish(const std::string &message) {
+      if (message != "CLIENT_FINISHED") {
+        logMessage("Unexpected final message from client: ", message);
+      }
+      reply("CLOSING_CONNECTION");
+      return close();
+    }
+};
+
+/*Timer callback, the answer window is over so the question counts as a timeout: the session is queued on its connection
+  and woken, it sends TIMEOUT and the next question without waiting for the client*/
+void onQuestionExpired(void *context) {
+  QuizSession *session = static_cast<QuizSession *>(context);
+  int pending = QUESTION_PENDING;
+  if (session->questionState.compare_exchange_strong(pending, QUESTION_EXPIRED)) {
+    logMessage("Answer window expired for socket: ", session->connection.socket);
+    {
+      std::lock_guard<std::mutex> lock(session->connection.expiryMutex);
+      session->connection.expiredSessions.push_back(session->id);
+    }
+    wakeConnection(session->connection);
+  }
+}
+
+/*Timer callback, a coroutine waited too long for its client to read*/
+void onWriteDeadline(void *context) {
+  Connection *connection = static_cast<Connection *>(context);
+  logMessage("Write deadline expired for ", connection->address);
+  shutdown(connection->socket, SHUT_RDWR);
+}
+
+QuizSession::QuizSession(Connection &clientConnection, uint32_t sessionId) : connection(clientConnection), id(sessionId) {
+  questionTimer.callback = onQuestionExpired;
+  questionTimer.context = this;
+}
+
+/*Sessions of a multiplexed connection: each has its own inbox and message bucket, and they are served one frame each in turn
+  so a busy player can not starve the others sharing the socket.
+  The connection may send messageRate frames per second for each of its sessions, up to gatewayMessageRate, and every
+  session gets an equal share of that budget. A frame over either limit is answered BUSY and dropped, nobody is disconnected*/
+class Multiplexer {
+  public:
+    Multiplexer(Connection &clientConnection) : connection(clientConnection) {
+      messageTokens.tokens = 2 * messageRate;
+    }
+
+    ~Multiplexer() {
+      std::vector<Player *> departed;
+      departed.reserve(sessions.size());
+      for (auto &entry : sessions) {
+        departed.push_back(entry.second->session.currentPlayer());
+      }
+      sessions.clear();
+      removeClientData(departed);
+    }
+
+    /*Function to queue a frame for its session, the session is created by its first frame*/
+    bool onFrame(const std::string &frame) {
+      if (frame.size() < sizeof(uint32_t)) {
+        logMessage("Multiplexed frame without session id from ", connection.address);
+        return false;
+      }
+      uint32_t sessionId = 0;
+      std::memcpy(&sessionId, frame.data(), sizeof(sessionId));
+      sessionId = ntohl(sessionId);
+      std::string_view message(frame.data() + sizeof(sessionId), frame.size() - sizeof(sessionId));
+      if (!messageTokens.consume(budget())) {
+        logDebug("Connection ", connection.address, " over its message budget");
+        secureSend(connection, "BUSY", sessionId);
+        return true;
+      }
+      auto it = sessions.find(sessionId);
+      if (it == sessions.end()) {
+        if (message == "MUX_CLOSE") {
+          return true;
+        }
+        if (sessionId == 0 || static_cast<int>(sessions.size()) >= maxSessionsPerConnection) {
+          secureSend(connection, "SESSION_REFUSED", sessionId);
+          return true;
+        }
+        it = sessions.emplace(sessionId, std::make_unique<Channel>(connection, sessionId)).first;
+        /*A new session brings its own burst to the connection, as a plain connection would*/
+        messageTokens.refill(budget());
+        messageTokens.tokens = std::min(messageTokens.tokens + 2 * share(), 2 * budget());
+        it->second->messageTokens.tokens = 2 * share();
+      }
+      Channel &channel = *it->second;
+      if (channel.finished) {
+        return true;
+      }
+      /*Armed again after a running callback is over, so a session that speaks is never reaped*/
+      timerWheel.arm(channel.idleTimer, std::chrono::seconds(idleTimeoutSeconds));
+      channel.idle = false;
+      if (!channel.messageTokens.consume(share())) {
+        logDebug("Session ", sessionId, " of ", connection.address, " over the message rate");
+        secureSend(connection, "BUSY", sessionId);
+        return true;
+      }
+      if (channel.inbox.size() >= MUX_INBOX_LIMIT) {
+        secureSend(connection, "BUSY", sessionId);
+        return true;
+      }
+      channel.inbox.emplace_back(message);
+      if (channel.inbox.size() == 1 && !channel.finished) {
+        ready.push_back(&channel);
+      }
+      return true;
+    }
+
+    /*Function to serve the queued frames round robin, it stops above the high watermark when the connection can not block on writes*/
+    bool pump() {
+      while (!ready.empty() && (connection.blockingWrites ||
+            connection.outQueue.size() - connection.outOffset <= OUTPUT_HIGH_WATERMARK)) {
+        Channel *channel = ready.front();
+        ready.pop_front();
+        if (channel->finished) {
+          continue;
+        }
+        std::string message = std::move(channel->inbox.front());
+        channel->inbox.pop_front();
+        if (message == "MUX_CLOSE" || !channel->session.onMessage(message)) {
+          finish(*channel);
+        } else if (!channel->inbox.empty()) {
+          ready.push_back(channel);
+        }
+      }
+      reap();
+      return true;
+    }
+
+    /*Function called for a session woken by a timer or by a kick: a silent one is reaped, otherwise the TIMEOUT of its
+      expired answer window or its KICKED goes out at once and not in turn*/
+    void expire(uint32_t sessionId) {
+      auto it = sessions.find(sessionId);
+      if (it == sessions.end() || it->second->finished) {
+        return;
+      }
+      Channel &channel = *it->second;
+      if (channel.idle) {
+        logMessage("Reaping idle session ", sessionId, " of ", connection.address);
+        finish(channel);
+      } else if (!channel.session.onExpired()) {
+        finish(channel);
+      }
+    }
+
+    bool pending() const { return !ready.empty(); }
+
+  private:
+    struct Channel {
+      QuizSession session;
+      TokenBucket messageTokens;
+      std::deque<std::string> inbox;
+      bool finished{false};
+      /*Reaps the session when its player stays silent too long, the connection may be kept busy by the others*/
+      Timer idleTimer;
+      std::atomic<bool> idle{false};
+
+      Channel(Connection &connection, uint32_t sessionId) : session(connection, sessionId) {
+        idleTimer.callback = onIdle;
+        idleTimer.context = this;
+      }
+
+      ~Channel() {
+        timerWheel.cancel(idleTimer);
+      }
+
+      /*Timer callback, queued on the connection like an expired answer window and finished once the connection is woken*/
+      static void onIdle(void *context) {
+        Channel *channel = static_cast<Channel *>(context);
+        channel->idle = true;
+        {
+          std::lock_guard<std::mutex> lock(channel->session.connection.expiryMutex);
+          channel->session.connection.expiredSessions.push_back(channel->session.id);
+        }
+        wakeConnection(channel->session.connection);
+      }
+    };
+
+    Connection &connection;
+    std::unordered_map<uint32_t, std::unique_ptr<Channel>> sessions;
+    TokenBucket messageTokens;
+    std::deque<Channel *> ready;
+    std::vector<uint32_t> finishedSessions;
+
+    /*Frames per second of the whole connection, 0 when unlimited*/
+    double budget() const {
+      if (messageRate <= 0) {
+        return 0;
+      }
+      double rate = messageRate * std::max<size_t>(1, sessions.size());
+      return (gatewayMessageRate > 0) ? std::min(rate, gatewayMessageRate) : rate;
+    }
+
+    /*Frames per second of one session, its fair share of the budget*/
+    double share() const {
+      return budget() / std::max<size_t>(1, sessions.size());
+    }
+
+    void finish(Channel &channel) {
+      if (!channel.finished) {
+        channel.finished = true;
+        channel.inbox.clear();
+        finishedSessions.push_back(channel.session.id);
+      }
+    }
+
+    /*Function to drop the sessions that ended since the last pass, their players leave in one batch*/
+    void reap() {
+      if (finishedSessions.empty()) {
+        return;
+      }
+      ready.erase(std::remove_if(ready.begin(), ready.end(), [](const Channel *channel) { return channel->finished; }),
+          ready.end());
+      std::vector<Player *> departed;
+      for (uint32_t sessionId : finishedSessions) {
+        auto it = sessions.find(sessionId);
+        departed.push_back(it->second->session.currentPlayer());
+        sessions.erase(it);
+      }
+      finishedSessions.clear();
+      removeClientData(departed);
+    }
+};
+
+/*What a connection feeds its frames to: its own quiz session, or the multiplexer once the client sent MUX as first frame*/
+class ConnectionHandler {
+  public:
+    ConnectionHandler(Connection &clientConnection) : connection(clientConnection), session(clientConnection) {}
+
+    ~ConnectionHandler() {
+      std::vector<Player *> departed{session.currentPlayer()};
+      removeClientData(departed);
+    }
+
+    /*Function to handle one frame, false when the connection has to be closed*/
+    bool onMessage(const std::string &message) {
+      if (multiplexer) {
+        return multiplexer->onFrame(message);
+      }
+      if (message == "MUX" && session.currentState() == AWAIT_START) {
+        secureSend(connection, "MUX_READY");
+        std::lock_guard<std::mutex> lock(connection.outMutex);
+        connection.multiplexed = true;
+        multiplexer = std::make_unique<Multiplexer>(connection);
+        logMessage("Connection ", connection.address, " multiplexed on socket ", connection.socket);
+        return true;
+      }
+      if (message.rfind("COMPRESS ", 0) == 0 && session.currentState() == AWAIT_START && connection.dictionary == nullptr) {
+        return negotiateCompression(message);
+      }
+      return session.onMessage(message);
+    }
+
+    /*Function called when the connection was woken for expired answer windows, false when the connection has to be closed*/
+    bool expire() {
+      connection.wakeRequested = false;
+      {
+        std::lock_guard<std::mutex> lock(connection.expiryMutex);
+        expired.swap(connection.expiredSessions);
+      }
+      bool open = true;
+      for (uint32_t sessionId : expired) {
+        if (multiplexer) {
+          multiplexer->expire(sessionId);
         } else {
-        Player newPlayer(message);
-          {
-            std::unique_lock<std::shared_mutex> lock(playersMutex);
-            players.emplace_back(clientSocket, newPlayer);
-          }
-          secureSend(clientSocket, "OK");
-          printScoreboard();
-          break;
+          open = open && session.onExpired();
         }
       }
+      expired.clear();
+      return open;
+    }
 
-      while (true) {
-        Player *currentPlayer = nullptr;
-        {
-          std::shared_lock<std::shared_mutex> lock(playersMutex);
-          auto it = std::find_if(players.begin(), players.end(),
-              [clientSocket](const std::pair<int, Player> &player) {
-              return player.first == clientSocket;
-              });
-          if (it != players.end()) {
-            currentPlayer = &it->second;
-          } else {
-            logMessage("Client data not found for socket: " + std::to_string(clientSocket));
-            close(clientSocket);
-            removeClientData(clientSocket);
-            return;
-          }
-        }
+    bool pump() { return multiplexer ? multiplexer->pump() : true; }
+    bool pending() const { return multiplexer && multiplexer->pending(); }
+    bool multiplexed() const { return multiplexer != nullptr; }
+    bool awaitingFinish() const { return !multiplexer && session.currentState() == AWAIT_FINISH; }
 
-        if (!secureReceive(clientSocket, message)) {
-          close(clientSocket);
-          removeClientData(clientSocket);
-          return;
+  private:
+    Connection &connection;
+    QuizSession session;
+    std::unique_ptr<Multiplexer> multiplexer;
+    /*Swapped with the queue of the connection, both keep their capacity*/
+    std::vector<uint32_t> expired;
+
+    /*Function to answer "COMPRESS <max frame>": the granted size and the dictionary go out uncompressed,
+      every frame after them may carry FRAME_COMPRESSED_FLAG in both directions*/
+    bool negotiateCompression(const std::string &message) {
+      long long requested = 0;
+      std::istringstream(message.substr(sizeof("COMPRESS") - 1)) >> requested;
+      size_t granted = static_cast<size_t>(std::clamp<long long>(requested, BUFFER_SIZE, MAX_FRAME_SIZE));
+      std::shared_ptr<const std::string> dictionary;
+      {
+        std::lock_guard<std::mutex> lock(questionsMutex);
+        dictionary = compressionDictionary;
+      }
+      if (!secureSend(connection, "COMPRESS_READY " + std::to_string(granted) + "\n" + *dictionary)) {
+        return false;
+      }
+      std::lock_guard<std::mutex> lock(connection.outMutex);
+      connection.dictionary = std::move(dictionary);
+      connection.maxFrame = granted;
+      logMessage("Connection ", connection.address, " compressed, frames up to ", granted, " bytes");
+      return true;
+    }
+};
+
+/*Function to wait until the client sent something or an answer window woke the session, false on a wake up.
+  The output is flushed first, the client may be waiting for it before it answers*/
+bool waitInput(Connection &connection) {
+  {
+    std::lock_guard<std::mutex> lock(connection.outMutex);
+    if (!waitOutput(connection, 0)) {
+      disconnectConnection(connection, "client too slow");
+      return true;
+    }
+  }
+  pollfd events[2] = {{connection.socket, POLLIN, 0}, {connection.wakeFd, POLLIN, 0}};
+  while (!connection.wakeRequested) {
+    /*With the rings there is nothing to sleep for while bytes are queued, otherwise the client is asked for a doorbell*/
+    if (connection.channel != nullptr) {
+      if (connection.readBuffer.size() > connection.readOffset || !connection.channel->toServer.empty()) {
+        return true;
+      }
+      connection.channel->serverWaiting = 1;
+      if (!connection.channel->toServer.empty()) {
+        return true;
+      }
+    }
+    if (poll(events, 2, -1) <= 0) {
+      continue;
+    }
+    if (events[1].revents != 0) {
+      uint64_t wakeUps;
+      read(connection.wakeFd, &wakeUps, sizeof(wakeUps));
+    }
+    if (events[0].revents != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*Function to receive a message with the idle timer armed while waiting: 1 with a frame, 0 when an answer window woke
+  the session first, -1 when the connection is over. The idle timer keeps running across the wake ups*/
+int sessionReceive(Connection &connection, std::string &message) {
+  if (!connection.idleArmed) {
+    timerWheel.arm(connection.idleTimer, std::chrono::seconds(idleTimeoutSeconds));
+    connection.idleArmed = true;
+  }
+  if (!waitInput(connection)) {
+    return 0;
+  }
+  bool received = secureReceive(connection, message);
+  timerWheel.cancel(connection.idleTimer);
+  connection.idleArmed = false;
+  return received ? 1 : -1;
+}
+
+/*Function run by the ticker thread of the threaded server, moves the timer wheel forward*/
+void timerThread() {
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(TIMER_TICK_MS));
+    timerWheel.advance(std::chrono::steady_clock::now());
+  }
+}
+
+/*Function to handle the client on its own thread, blocking on every receive*/
+void handleClient(int clientSocket, std::string address, AddressLimiter *limiter) {
+  logMessage("********** ENTERING handleClient **********");
+  Connection connection(clientSocket, address, limiter);
+  /*The answer windows wake this thread through it while it sleeps on the socket*/
+  connection.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (connection.wakeFd < 0) {
+    logMessage("Error creating the wake up of socket ", clientSocket, ", expired windows wait for the next frame");
+  }
+  try {
+    ConnectionHandler handler(connection);
+    std::string &message = connection.inBuffer;
+    bool open = true;
+    int status;
+    while (open && (status = sessionReceive(connection, message)) >= 0) {
+      open = (status > 0 ? handler.onMessage(message) : handler.expire()) && handler.pump();
+    }
+    if (handler.awaitingFinish()) {
+      logMessage("Failed to receive final confirmation from client");
+    }
+    std::lock_guard<std::mutex> lock(connection.outMutex);
+    waitOutput(connection, 0);
+  } catch (const std::exception &e) {
+    logMessage("Exception in handleClient: ", e.what());
+  }
+  logMessage("********** EXITING handleClient **********");
+}
+
+/*Function to allocate coroutine frames, the common sizes come from the block pools*/
+void *allocateFrame(size_t size) {
+  if (size <= 1024) {
+    return BlockPool<1024>::instance().allocate();
+  }
+  if (size <= 4096) {
+    return BlockPool<4096>::instance().allocate();
+  }
+  return ::operator new(size);
+}
+
+void deallocateFrame(void *frame, size_t size) {
+  if (size <= 1024) {
+    BlockPool<1024>::instance().deallocate(frame);
+  } else if (size <= 4096) {
+    BlockPool<4096>::instance().deallocate(frame);
+  } else {
+    ::operator delete(frame);
+  }
+}
+
+/*Coroutine type of a session: starts suspended so the scheduler decides where it runs, its frame is freed when it ends*/
+struct SessionTask {
+  struct promise_type {
+    SessionTask get_return_object() { return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { logMessage("Exception in session coroutine"); }
+    static void *operator new(size_t size) { return allocateFrame(size); }
+    static void operator delete(void *frame, size_t size) { deallocateFrame(frame, size); }
+  };
+  std::coroutine_handle<promise_type> handle;
+};
+
+/*Work-stealing pool: each worker pops its own deque LIFO and steals FIFO from the others when it runs dry*/
+class Scheduler {
+  public:
+    void start(size_t workerCount) {
+      for (size_t i = 0; i < workerCount; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+      }
+      for (size_t i = 0; i < workerCount; ++i) {
+        std::thread(&Scheduler::run, this, i).detach();
+      }
+    }
+
+    /*Function to queue a coroutine, on the current worker when called from one so the cache stays warm*/
+    void schedule(std::coroutine_handle<> handle) {
+      size_t index = (currentWorker >= 0) ? currentWorker : nextWorker++ % workers.size();
+      {
+        std::lock_guard<std::mutex> lock(workers[index]->dequeMutex);
+        workers[index]->tasks.push_back(handle);
+      }
+      pendingTasks++;
+      {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+      }
+      wakeUp.notify_one();
+    }
+
+  private:
+    struct Worker {
+      std::mutex dequeMutex;
+      std::deque<std::coroutine_handle<>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> nextWorker{0};
+    std::atomic<size_t> pendingTasks{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    static thread_local int currentWorker;
+
+    bool take(size_t index, std::coroutine_handle<> &handle) {
+      {
+        Worker &own = *workers[index];
+        std::lock_guard<std::mutex> lock(own.dequeMutex);
+        if (!own.tasks.empty()) {
+          handle = own.tasks.back();
+          own.tasks.pop_back();
+          pendingTasks--;
+          return true;
         }
-        int theme;
-        try {
-          theme = std::stoi(message);
-        } catch (const std::exception &e) {
-          logMessage("Invalid input for theme selection: " + message);
-          secureSend(clientSocket, "INVALID_THEME");
-          continue;
+      }
+      for (size_t offset = 1; offset < workers.size(); ++offset) {
+        Worker &victim = *workers[(index + offset) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.dequeMutex);
+        if (!victim.tasks.empty()) {
+          handle = victim.tasks.front();
+          victim.tasks.pop_front();
+          pendingTasks--;
+          return true;
         }
-        if (theme != 1 && theme != 2) {
-          secureSend(clientSocket, "INVALID_THEME");
+      }
+      return false;
+    }
+
+    void run(size_t index) {
+      currentWorker = static_cast<int>(index);
+      std::coroutine_handle<> handle;
+      while (true) {
+        if (take(index, handle)) {
+          handle.resume();
           continue;
         }
-        bool isCompleted = false;
-        {
-        std::shared_lock<std::shared_mutex> lock(playersMutex);
-        isCompleted = (theme == 1 && currentPlayer->hasCompletedTech) || 
-                    (theme == 2 && currentPlayer->hasCompletedGeneral);
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait_for(lock, std::chrono::milliseconds(TIMER_TICK_MS), [this] { return pendingTasks > 0; });
+      }
+    }
+};
+
+thread_local int Scheduler::currentWorker = -1;
+Scheduler scheduler;
+
+/*Single epoll thread: resumes the coroutine waiting on a ready socket and drives the timer wheel.
+  Sockets are armed one shot, so each readiness resumes exactly one waiter*/
+class Reactor {
+  public:
+    bool start() {
+      epollSocket = epoll_create1(0);
+      if (epollSocket < 0) {
+        return false;
+      }
+      std::thread(&Reactor::run, this).detach();
+      return true;
+    }
+
+    void add(Connection &connection) {
+      epoll_event event{};
+      event.events = EPOLLONESHOT;
+      event.data.ptr = &connection;
+      epoll_ctl(epollSocket, EPOLL_CTL_ADD, connection.socket, &event);
+    }
+
+    /*Function to arm the socket for one event, added back if a wake up took it out of the set*/
+    void arm(Connection &connection, uint32_t events) {
+      epoll_event event{};
+      event.events = events | EPOLLONESHOT;
+      event.data.ptr = &connection;
+      if (epoll_ctl(epollSocket, EPOLL_CTL_MOD, connection.socket, &event) < 0 && errno == ENOENT) {
+        epoll_ctl(epollSocket, EPOLL_CTL_ADD, connection.socket, &event);
+      }
+    }
+
+    void remove(Connection &connection) {
+      epoll_ctl(epollSocket, EPOLL_CTL_DEL, connection.socket, nullptr);
+    }
+
+    /*Function to schedule the coroutine that waited for an event of the connection, the one shot event is spent*/
+    void resume(Connection &connection) {
+      std::coroutine_handle<> waiting;
+      {
+        std::lock_guard<std::mutex> lock(connection.waitMutex);
+        waiting = std::exchange(connection.waiting, nullptr);
+      }
+      if (waiting) {
+        scheduler.schedule(waiting);
+      }
+    }
+
+    /*Function to resume a coroutine before its event: the socket leaves the set first, since a mask without events
+      still reports a hang up. Runs on this thread after the events of the batch, so once the coroutine is scheduled
+      no event can name the connection and it may end and free its frame*/
+    void wake(Connection &connection) {
+      std::coroutine_handle<> waiting;
+      {
+        std::lock_guard<std::mutex> lock(connection.waitMutex);
+        waiting = std::exchange(connection.waiting, nullptr);
+        if (waiting) {
+          epoll_ctl(epollSocket, EPOLL_CTL_DEL, connection.socket, nullptr);
         }
-        if (isCompleted) {
-        logMessage("Player " + currentPlayer->nickname + " attempted to repeat completed theme: " + std::to_string(theme));
-        secureSend(clientSocket, "ALREADY_COMPLETED");
-        continue;
+      }
+      if (waiting) {
+        scheduler.schedule(waiting);
+      }
+    }
+
+  private:
+    int epollSocket{-1};
+
+    void run() {
+      epoll_event events[256];
+      while (true) {
+        int ready = epoll_wait(epollSocket, events, 256, TIMER_TICK_MS);
+        for (int i = 0; i < ready; ++i) {
+          resume(*static_cast<Connection *>(events[i].data.ptr));
         }
+        timerWheel.advance(std::chrono::steady_clock::now());
+      }
+    }
+};
 
-        secureSend(clientSocket, "OK");
-        auto &questions = (theme == 1) ? techQuestions : generalQuestions;
-        for (size_t i = 0; i < questions.size(); ++i) {
-          secureSend(clientSocket, questions[i].question);
-          logMessage("Sent question: " + questions[i].question);
-          if (!secureReceive(clientSocket, message)) {
-            close(clientSocket);
-            removeClientData(clientSocket);
-            return;
-          }
-          if (message == "show score") {
-            sendScoreboard(clientSocket);
-            --i;
-            logMessage("Sent scoreboard");
-            continue;
-          }
-          if (message == "endquiz") {
-            secureSend(clientSocket, "Quiz terminated.");
-            logMessage("Quiz terminated.");
-            close(clientSocket);
-            removeClientData(clientSocket);
-            return;
+Reactor reactor;
+
+/*Function to wake the session of a connection for its expired answer windows: the threaded server through the eventfd,
+  the coroutine server by resuming the coroutine parked on the socket. Only timer callbacks call it, in the coroutine
+  server they run on the reactor thread*/
+void wakeConnection(Connection &connection) {
+  connection.wakeRequested = true;
+  if (connection.wakeFd >= 0) {
+    uint64_t wakeUp = 1;
+    write(connection.wakeFd, &wakeUp, sizeof(wakeUp));
+    return;
+  }
+  reactor.wake(connection);
+}
+
+/*Awaitable that parks the session until its socket is readable or writable, a read is also given up when woken*/
+struct SocketReady {
+  Connection &connection;
+  uint32_t events;
+
+  bool await_ready() const noexcept { return false; }
+  bool await_suspend(std::coroutine_handle<> handle) {
+    /*Unlocking is the last touch of the frame: the handle is only taken under the lock, then another worker may resume it*/
+    std::lock_guard<std::mutex> lock(connection.waitMutex);
+    if ((events & EPOLLIN) && connection.wakeRequested) {
+      return false;
+    }
+    connection.waiting = handle;
+    reactor.arm(connection, transportEvents(connection, events));
+    return true;
+  }
+  void await_resume() const noexcept {}
+};
+
+/*Function to write the output queue without blocking: 1 when empty, 0 when the socket is full, -1 on error*/
+int drainOutput(Connection &connection) {
+  std::lock_guard<std::mutex> lock(connection.outMutex);
+  if (!flushOutput(connection)) {
+    disconnectConnection(connection, "send failed");
+    return -1;
+  }
+  return (connection.outQueue.size() == connection.outOffset) ? 1 : 0;
+}
+
+/*Coroutine running a session on the worker pool, it suspends instead of blocking on reads and writes*/
+SessionTask runSession(int clientSocket, std::string address, AddressLimiter *limiter) {
+  logMessage("********** ENTERING runSession **********");
+  Connection connection(clientSocket, address, limiter);
+  connection.blockingWrites = false;
+  connection.writeTimer.callback = onWriteDeadline;
+  connection.writeTimer.context = &connection;
+  std::string &message = connection.inBuffer;
+  reactor.add(connection);
+  {
+    ConnectionHandler handler(connection);
+    try {
+      bool open = true;
+      while (true) {
+        /*Replies must reach the client before its next request is read, like in the threaded server*/
+        int drained = drainOutput(connection);
+        if (drained == 0) {
+          timerWheel.arm(connection.writeTimer, std::chrono::milliseconds(WRITE_DEADLINE_MS));
+          while (drained == 0) {
+            co_await SocketReady{connection, EPOLLOUT};
+            drained = drainOutput(connection);
           }
-        if (message == questions[i].answer) {
-        std::string playerName;
-        {
-            std::unique_lock<std::shared_mutex> lock(playersMutex);
-            auto it = std::find_if(players.begin(), players.end(),
-                [clientSocket](const std::pair<int, Player>& player) {
-                return player.first == clientSocket;
-                });
-            if (it != players.end()) {
-            if (theme == 1) {
-                it->second.techScore++;
-                playerName = it->second.nickname;
-                logMessage("Player " + playerName + " scored a point in tech quiz, now has: " + std::to_string(it->second.techScore));
-            } else {
-                it->second.generalScore++;
-                playerName = it->second.nickname;
-                logMessage("Player " + playerName + " scored a point in general quiz, now has: " + std::to_string(it->second.generalScore));
-            }
-            }
+          timerWheel.cancel(connection.writeTimer);
         }
-          }
-          secureSend(clientSocket, (message == questions[i].answer) ? "CORRECT" : "INCORRECT");
-          printScoreboard();
+        if (drained < 0 || !open) {
+          break;
         }
-
-        {
-        std::unique_lock<std::shared_mutex> lock(playersMutex);
-        auto it = std::find_if(players.begin(), players.end(),
-            [clientSocket](const std::pair<int, Player>& player) {
-            return player.first == clientSocket;
-            });
-        
-        if (it != players.end()) {
-            if (theme == 1) {
-                it->second.hasCompletedTech = true;
-                logMessage("Player " + it->second.nickname + " completed tech quiz with score: " + 
-                        std::to_string(it->second.techScore) + "/" + std::to_string(techQuestions.size()));
-            } else {
-                it->second.hasCompletedGeneral = true;
-                logMessage("Player " + it->second.nickname + " completed general quiz with score: " + 
-                        std::to_string(it->second.generalScore) + "/" + std::to_string(generalQuestions.size()));
-            }
-            currentPlayer = &it->second;
+        /*Multiplexed sessions left waiting by the high watermark are served before reading more*/
+        if (handler.pending()) {
+          open = handler.pump();
+          continue;
         }
+        /*The idle timer keeps running across the wake ups of the answer windows, it only measures the silence of the client*/
+        if (!connection.idleArmed) {
+          timerWheel.arm(connection.idleTimer, std::chrono::seconds(idleTimeoutSeconds));
+          connection.idleArmed = true;
         }
-
-        bool oneQuizCompleted = false;
-        {
-        std::shared_lock<std::shared_mutex> lock(playersMutex);
-        oneQuizCompleted = (currentPlayer->hasCompletedTech && !currentPlayer->hasCompletedGeneral) ||
-                        (!currentPlayer->hasCompletedTech && currentPlayer->hasCompletedGeneral);
+        int status;
+        while ((status = readFrame(connection, message)) == 0 && !connection.wakeRequested) {
+          co_await SocketReady{connection, EPOLLIN};
         }
-        if (oneQuizCompleted) {
-        logMessage("Player " + currentPlayer->nickname + " completed one quiz, can continue with the other");
-        secureSend(clientSocket, "COMPLETED_QUIZ");
-        printScoreboard();
-        continue;
+        if (status == 0) {
+          open = handler.expire() && handler.pump();
+          continue;
         }
-        {
-        bool bothCompleted = false;
-        {
-        std::shared_lock<std::shared_mutex> lock(playersMutex);
-        bothCompleted = currentPlayer->hasCompletedTech && currentPlayer->hasCompletedGeneral;
+        timerWheel.cancel(connection.idleTimer);
+        connection.idleArmed = false;
+        open = status > 0 && handler.onMessage(message);
+        /*The rest of a multiplexed burst is queued too, so its sessions are served in turn and not in arrival order*/
+        while (open && handler.multiplexed() && (status = readFrame(connection, message)) > 0) {
+          open = handler.onMessage(message);
         }
-
-        if (bothCompleted) {
-        secureSend(clientSocket, "BOTH_QUIZZES_COMPLETED");
-        logMessage("Player " + currentPlayer->nickname + " completed both quizzes");
-        printScoreboard();
-        
-        if (!secureReceive(clientSocket, message)) {
-            logMessage("Failed to receive final confirmation from client");
-        } else if (message != "CLIENT_FINISHED") {
-            logMessage("Unexpected final message from client: " + message);
-        }
-        
-        secureSend(clientSocket, "CLOSING_CONNECTION");
-        break;
+        if (status < 0) {
+          break;
         }
+        open = open && handler.pump();
+      }
+      if (handler.awaitingFinish()) {
+        logMessage("Failed to receive final confirmation from client");
+      }
+    } catch (const std::exception &e) {
+      logMessage("Exception in runSession: ", e.what());
     }
+  }
+  timerWheel.cancel(connection.writeTimer);
+  reactor.remove(connection);
+  logMessage("********** EXITING runSession **********");
+}
+
+/*Function to list a page of the players, copied under a shared hold of O(page) and formatted after releasing it*/
+void adminSessions(std::string &out, size_t first, size_t count) {
+  struct Row {
+    int socket;
+    Nickname nickname;
+    std::vector<std::pair<int, bool>> scores;
+  };
+  std::vector<Row> rows;
+  size_t total = 0;
+  {
+    std::shared_lock<std::shared_mutex> lock(playersMutex);
+    total = players.size();
+    for (size_t index = first; index < total && index < first + count; ++index) {
+      const Player &player = *players[index].second;
+      rows.push_back({players[index].first, player.nickname, {}});
+      for (size_t theme = 1; theme <= rankings.size(); ++theme) {
+        rows.back().scores.emplace_back(scoreTable.score(player.slot, theme), scoreTable.completed(player.slot, theme));
       }
     }
-  } catch (const std::exception &e) {
-    logMessage("Exception in handleClient: " + std::string(e.what()));
   }
-  close(clientSocket);
-  removeClientData(clientSocket);
-  logMessage("********** EXITING handleClient **********");
+  size_t connectionCount = 0;
+  {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    connectionCount = connections.size();
+  }
+  out += "giocatori " + std::to_string(total) + " connessioni " + std::to_string(connectionCount) + "\n";
+  for (const Row &row : rows) {
+    out += std::to_string(row.socket) + " " + row.nickname.str();
+    for (size_t theme = 1; theme <= row.scores.size(); ++theme) {
+      out += " " + std::to_string(theme) + ":" + std::to_string(row.scores[theme - 1].first) +
+        (row.scores[theme - 1].second ? "*" : "");
+    }
+    out += "\n";
+  }
 }
 
-/*Function to handle the signal interrupt and terminate the server*/
-void signalHandler(int signum) {
-  logMessage("Interrupt signal (" + std::to_string(signum) + ") received. Closing server...");
+/*Function to list the first `count` players of a theme, the ranking tree walks O(count) nodes*/
+void adminTop(std::string &out, int theme, size_t count) {
+  std::vector<RankKey> rows;
   {
-    std::unique_lock<std::shared_mutex> lock(playersMutex);
-    for (const auto &player : players) {
-      secureSend(player.first, "SERVER_TERMINATED");
-      logMessage("Sent SERVER_TERMINATED to player: " + player.second.nickname);
-      close(player.first);
+    std::shared_lock<std::shared_mutex> lock(playersMutex);
+    for (auto it = rankings[theme - 1].begin(); it != rankings[theme - 1].end() && rows.size() < count; ++it) {
+      rows.push_back(*it);
+    }
+  }
+  for (size_t index = 0; index < rows.size(); ++index) {
+    out += std::to_string(index + 1) + ". " + rows[index].second.str() + " " + std::to_string(-rows[index].first) + "\n";
+  }
+}
+
+/*Function to kick a player, found in O(1) by nickname: a connection of its own is shut down, a multiplexed session is
+  queued on its connection and woken at the next tick, so both end at once even if the player never speaks again*/
+bool adminKick(const std::string &nickname) {
+  std::shared_lock<std::shared_mutex> lock(playersMutex);
+  auto found = playersByName.find(nickname);
+  if (found == playersByName.end()) {
+    return false;
+  }
+  Player &player = *found->second;
+  player.kicked = true;
+  /*While the player is listed its connection is open, so the socket can not belong to someone else yet*/
+  std::lock_guard<std::mutex> connectionsLock(connectionsMutex);
+  auto it = connections.find(player.socket);
+  if (it != connections.end()) {
+    Connection &connection = *it->second;
+    if (!connection.multiplexed) {
+      shutdown(connection.socket, SHUT_RDWR);
+    } else {
+      {
+        std::lock_guard<std::mutex> expiryLock(connection.expiryMutex);
+        connection.expiredSessions.push_back(player.session);
+      }
+      timerWheel.arm(connection.wakeTimer, std::chrono::milliseconds(0));
+    }
+  }
+  logMessage("Admin kicked player: ", player.nickname);
+  return true;
+}
+
+/*Function to run one admin command and append its reply*/
+void adminCommand(const std::string &line, std::string &out) {
+  std::istringstream in(line);
+  std::string command;
+  in >> command;
+  if (command == "sessions") {
+    long long first = 1, count = SCOREBOARD_PAGE, value = 0;
+    if (in >> value) {
+      first = value;
+      if (in >> value) {
+        count = value;
+      }
+    }
+    adminSessions(out, static_cast<size_t>(std::max(first, 1LL) - 1),
+        static_cast<size_t>(std::clamp<long long>(count, 0, ADMIN_PAGE_LIMIT)));
+  } else if (command == "top") {
+    int theme = 0;
+    long long count = SCOREBOARD_PAGE, value = 0;
+    if (in >> theme >> value) {
+      count = value;
+    }
+    if (!validTheme(theme)) {
+      out += "ERRORE tema non valido\n";
+    } else {
+      adminTop(out, theme, static_cast<size_t>(std::clamp<long long>(count, 0, ADMIN_PAGE_LIMIT)));
+    }
+  } else if (command == "kick") {
+    std::string nickname;
+    std::getline(in >> std::ws, nickname);
+    out += adminKick(nickname) ? "OK\n" : "ERRORE giocatore non trovato\n";
+  } else if (command == "reload") {
+    std::vector<Theme> loaded;
+    std::string error;
+    if (!loadThemes(loaded, error)) {
+      out += "ERRORE " + error + ", restano le domande attuali\n";
+    } else {
+      out += "OK temi " + std::to_string(loaded.size()) + "\n";
+      for (size_t index = 0; index < loaded.size(); ++index) {
+        out += std::to_string(index + 1) + " " + loaded[index].name + " " + std::to_string(loaded[index].bank->size()) + "\n";
+      }
+      installThemes(std::move(loaded));
+      logMessage("Admin reloaded the themes");
+    }
+  } else if (command == "stats") {
+    std::string path = statsFile;
+    in >> path;
+    analytics.merge();
+    if (path.empty()) {
+      out += "ERRORE nessun file, usa stats <file>\n";
+    } else {
+      out += analytics.dump(path) ? "OK " + path + "\n" : "ERRORE scrittura di " + path + "\n";
+    }
+  } else if (command == "loglevel") {
+    std::string level;
+    in >> level;
+    if (level == "debug" || level == "info" || level == "off") {
+      logLevel = (level == "debug") ? LOG_DEBUG : ((level == "info") ? LOG_INFO : LOG_OFF);
+      out += "OK\n";
+    } else {
+      out += "ERRORE livelli: debug info off\n";
+    }
+  } else if (command == "help") {
+    out += "sessions [prima] [quante]\ntop <tema> [quanti]\nkick <nickname>\nreload\nstats [file]\n"
+      "loglevel <debug|info|off>\n";
+  } else {
+    out += "ERRORE comando sconosciuto, prova help\n";
+  }
+}
+
+/*Function to serve an admin client: one command per line, every reply ends with an empty line*/
+void handleAdmin(int adminSocket) {
+  std::string pending;
+  char chunk[BUFFER_SIZE];
+  while (true) {
+    size_t lineEnd;
+    while ((lineEnd = pending.find('\n')) != std::string::npos) {
+      std::string line = pending.substr(0, lineEnd);
+      pending.erase(0, lineEnd + 1);
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      std::string reply;
+      adminCommand(line, reply);
+      reply += "\n";
+      for (size_t sent = 0; sent < reply.size();) {
+        ssize_t bytes = send(adminSocket, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+        if (bytes <= 0) {
+          close(adminSocket);
+          return;
+        }
+        sent += bytes;
+      }
+    }
+    if (pending.size() > BUFFER_SIZE) {
+      break;
+    }
+    ssize_t bytes = recv(adminSocket, chunk, sizeof(chunk), 0);
+    if (bytes <= 0) {
+      break;
+    }
+    pending.append(chunk, bytes);
+  }
+  close(adminSocket);
+}
+
+/*Function to accept the admin clients, each one gets its own thread so a slow operator never delays another*/
+void adminThread(int listenSocket) {
+  while (true) {
+    int adminSocket = accept(listenSocket, nullptr, nullptr);
+    if (adminSocket < 0) {
+      perror("Admin accept failed");
+      continue;
+    }
+    std::thread(handleAdmin, adminSocket).detach();
+  }
+}
+
+/*Function run by the signal thread: SIGINT and SIGTERM are blocked in every thread and taken here with sigwait,
+  so the shutdown runs in normal thread context and may lock, allocate and write files*/
+void signalThread(sigset_t signals) {
+  int signum = 0;
+  while (sigwait(&signals, &signum) != 0) {
+  }
+  logMessage("Interrupt signal (", signum, ") received. Closing server...");
+  {
+    /*Only non-blocking writes while holding the lock, a client that stopped reading can not stall the shutdown*/
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    for (const auto &entry : connections) {
+      sendNow(*entry.second, "SERVER_TERMINATED");
+      logMessage("Sent SERVER_TERMINATED to: ", entry.second->address);
+      shutdown(entry.first, SHUT_RDWR);
     }
   }
+  recorder.flush();
+  if (!statsFile.empty()) {
+    analytics.merge();
+    analytics.dump(statsFile);
+  }
+  unlink(unixSocketPath.c_str());
+  unlink(adminSocketPath.c_str());
   logMessage("All client connections closed. Shutting down server.");
-  exit(signum);
+  /*The detached workers are still running, so no static destructor may run under them: everything is flushed and the process leaves at once*/
+  fflush(stdout);
+  _exit(signum);
+}
+
+/*Function to read the command line options, returns false on invalid input*/
+bool parseArguments(int argc, char *argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    std::string option = argv[i];
+    if (i + 1 >= argc) {
+      return false;
+    }
+    std::string value = argv[++i];
+    try {
+      if (option == "--answer-window") {
+        size_t separator = value.find('=');
+        int theme = std::stoi(value.substr(0, separator));
+        int seconds = std::stoi(value.substr(separator + 1));
+        if (separator == std::string::npos || theme < 1 || seconds <= 0) {
+          return false;
+        }
+        answerWindowOverrides[theme] = seconds;
+      } else if (option == "--record") {
+        if (!recorder.open(value)) {
+          std::cerr << "Impossibile aprire il file di cattura: " << value << "\n";
+          return false;
+        }
+      } else if (option == "--max-per-ip") {
+        maxConnectionsPerIp = std::stoi(value);
+      } else if (option == "--connection-rate") {
+        connectionRate = std::stod(value);
+      } else if (option == "--message-rate") {
+        messageRate = std::stod(value);
+      } else if (option == "--unix") {
+        unixSocketPath = value;
+        if (unixSocketPath.empty() || unixSocketPath.size() >= sizeof(sockaddr_un::sun_path)) {
+          return false;
+        }
+      } else if (option == "--themes") {
+        themesDirectory = value;
+      } else if (option == "--stats-file") {
+        statsFile = value;
+      } else if (option == "--gateway-message-rate") {
+        gatewayMessageRate = std::stod(value);
+      } else if (option == "--max-sessions") {
+        maxSessionsPerConnection = std::stoi(value);
+        if (maxSessionsPerConnection <= 0) {
+          return false;
+        }
+      } else if (option == "--admin") {
+        adminSocketPath = value;
+        if (adminSocketPath.empty() || adminSocketPath.size() >= sizeof(sockaddr_un::sun_path)) {
+          return false;
+        }
+      } else if (option == "--log-level") {
+        if (value != "debug" && value != "info" && value != "off") {
+          return false;
+        }
+        logLevel = (value == "debug") ? LOG_DEBUG : ((value == "info") ? LOG_INFO : LOG_OFF);
+      } else if (option == "--mode") {
+        if (value != "threaded" && value != "coroutine") {
+          return false;
+        }
+        coroutineMode = value == "coroutine";
+      } else if (option == "--workers") {
+        workerCount = std::stoi(value);
+        if (workerCount <= 0) {
+          return false;
+        }
+      } else if (option == "--idle-timeout") {
+        idleTimeoutSeconds = std::stoi(value);
+        if (idleTimeoutSeconds <= 0) {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    } catch (const std::exception &e) {
+      return false;
+    }
+  }
+  return true;
 }
 
-/*Function to handle the SIGPIPE signal*/
-void handleSigpipe(int sig) {
-  logMessage("SIGPIPE received. Ignoring.");
+/*Function to accept the clients of a listener and start their sessions, local ones come from the Unix socket*/
+void acceptClients(int serverSocket, bool local) {
+  while (true) {
+    sockaddr_in clientAddr;
+    socklen_t clientLen = sizeof(clientAddr);
+    int clientSocket = accept(serverSocket, (sockaddr *)&clientAddr, &clientLen);
+    if (clientSocket < 0) {
+      perror("Accept failed");
+      continue;
+    }
+    /*A local peer is limited per process, like a remote one per address: co-located bots do not share one budget*/
+    char clientIP[INET_ADDRSTRLEN] = "local";
+    if (!local) {
+      inet_ntop(AF_INET, &clientAddr.sin_addr, clientIP, sizeof(clientIP));
+    } else {
+      ucred peer{};
+      socklen_t peerLen = sizeof(peer);
+      if (getsockopt(clientSocket, SOL_SOCKET, SO_PEERCRED, &peer, &peerLen) == 0) {
+        snprintf(clientIP, sizeof(clientIP), "local:%d", static_cast<int>(peer.pid));
+      }
+    }
+    AddressLimiter *limiter = admitConnection(clientIP);
+    if (limiter == nullptr) {
+      logMessage("Connection refused, limits exceeded for: ", clientIP);
+      close(clientSocket);
+      continue;
+    }
+    /*Frames are already written whole from the output queue, Nagle would only delay them*/
+    if (!local) {
+      int noDelay = 1;
+      setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+    if (coroutineMode) {
+      fcntl(clientSocket, F_SETFL, fcntl(clientSocket, F_GETFL, 0) | O_NONBLOCK);
+      scheduler.schedule(runSession(clientSocket, std::string(clientIP), limiter).handle);
+    } else {
+      std::thread(handleClient, clientSocket, std::string(clientIP), limiter).detach();
+    }
+  }
 }
 
 /*Main function, loads questions, creates server socket, binds it, listens for clients and creates a thread for each client*/
-int main() {
+int main(int argc, char *argv[]) {
+  if (!parseArguments(argc, argv)) {
+    std::cerr << "Uso: " << argv[0] << " [--answer-window <tema>=<secondi>] [--idle-timeout <secondi>]"
+      << " [--max-per-ip <connessioni>] [--connection-rate <al secondo>] [--message-rate <al secondo>]"
+      << " [--record <file>] [--mode <threaded|coroutine>] [--workers <thread>] [--unix <percorso>]"
+      << " [--max-sessions <per connessione>] [--gateway-message-rate <al secondo>] [--stats-file <file>] [--admin <percorso>] [--log-level <debug|info|off>]"
+      << " [--themes <cartella>]\n";
+    return 1;
+  }
   logMessage("------------------------------ SERVER START -----------------------------");
-  std::signal(SIGINT, signalHandler);
-  std::signal(SIGTERM, signalHandler);
-  signal(SIGPIPE, handleSigpipe);
+  /*Blocked before any other thread starts, they all inherit the mask and only the signal thread receives them*/
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  std::thread(signalThread, signals).detach();
+  /*Writes to a closed peer fail with EPIPE instead*/
+  signal(SIGPIPE, SIG_IGN);
   printScoreboard();
   try {
-    techQuestions = loadQuestions("tech.txt");
-    generalQuestions = loadQuestions("general.txt");
+    std::vector<Theme> loaded;
+    std::string error;
+    if (!loadThemes(loaded, error)) {
+      std::cerr << "Impossibile caricare i temi: " << error << "\n";
+      exit(EXIT_FAILURE);
+    }
+    for (size_t theme = 1; theme <= loaded.size(); ++theme) {
+      logMessage("Loaded theme ", theme, ": ", loaded[theme - 1].name, " (", loaded[theme - 1].bank->size(), " questions)");
+    }
+    installThemes(std::move(loaded));
 
     int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
     if (serverSocket < 0) {
@@ -539,22 +3293,51 @@ int main() {
       exit(EXIT_FAILURE);
     }
 
-    printf("Server listening on port %d\n", PORT);
-
-    while (true) {
-      sockaddr_in clientAddr;
-      socklen_t clientLen = sizeof(clientAddr);
-      int clientSocket = accept(serverSocket, (sockaddr *)&clientAddr, &clientLen);
-      if (clientSocket < 0) {
-        perror("Accept failed");
-        continue;
+    /*In coroutine mode the reactor thread drives the timer wheel*/
+    if (coroutineMode) {
+      if (!reactor.start()) {
+        perror("Epoll creation failed");
+        exit(EXIT_FAILURE);
       }
-      std::thread(handleClient, clientSocket).detach();
+      scheduler.start(workerCount);
+    } else {
+      std::thread(timerThread).detach();
+    }
+    printf("Server listening on port %d (%s)\n", PORT, coroutineMode ? "coroutine" : "threaded");
+    std::thread(consoleThread).detach();
+    std::thread(analyticsThread).detach();
+
+    /*Clients on the same host can skip the TCP stack, both listeners feed the same sessions*/
+    int localSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un localAddr{};
+    localAddr.sun_family = AF_UNIX;
+    std::strncpy(localAddr.sun_path, unixSocketPath.c_str(), sizeof(localAddr.sun_path) - 1);
+    unlink(unixSocketPath.c_str());
+    if (localSocket < 0 || bind(localSocket, (sockaddr *)&localAddr, sizeof(localAddr)) < 0 ||
+        listen(localSocket, MAX_CLIENT) < 0) {
+      perror("Local socket failed");
+      exit(EXIT_FAILURE);
+    }
+    printf("Server listening on %s\n", unixSocketPath.c_str());
+
+    /*Admin channel, only the owner of the server may connect*/
+    int adminSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un adminAddr{};
+    adminAddr.sun_family = AF_UNIX;
+    std::strncpy(adminAddr.sun_path, adminSocketPath.c_str(), sizeof(adminAddr.sun_path) - 1);
+    unlink(adminSocketPath.c_str());
+    if (adminSocket < 0 || bind(adminSocket, (sockaddr *)&adminAddr, sizeof(adminAddr)) < 0 ||
+        chmod(adminSocketPath.c_str(), 0600) < 0 || listen(adminSocket, MAX_CLIENT) < 0) {
+      perror("Admin socket failed");
+      exit(EXIT_FAILURE);
     }
+    std::thread(adminThread, adminSocket).detach();
+    std::thread(acceptClients, localSocket, true).detach();
+    acceptClients(serverSocket, false);
 
     close(serverSocket);
   } catch (const std::exception &e) {
-    logMessage("Exception in main: " + std::string(e.what()));
+    logMessage("Exception in main: ", e.what());
     return EXIT_FAILURE;
   }
   return 0;
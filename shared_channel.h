@@ -0,0 +1,55 @@
+#ifndef SHARED_CHANNEL_H
+#define SHARED_CHANNEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*Shared memory transport of the local clients, included by the server and by the client core since both processes map the same region*/
+#define SHM_RING_SIZE (1 << 16)
+
+/*One direction of the shared memory transport: a single producer single consumer byte ring carrying the same frames as the sockets.
+  Head and tail only grow, their difference is the amount of queued bytes*/
+struct SharedRing {
+  alignas(64) std::atomic<uint64_t> head{0};
+  alignas(64) std::atomic<uint64_t> tail{0};
+  alignas(64) char data[SHM_RING_SIZE];
+
+  size_t write(const char *bytes, size_t length) {
+    uint64_t currentTail = tail.load(std::memory_order_relaxed);
+    length = std::min<size_t>(length, SHM_RING_SIZE - (currentTail - head.load(std::memory_order_acquire)));
+    size_t offset = currentTail % SHM_RING_SIZE;
+    size_t first = std::min<size_t>(length, SHM_RING_SIZE - offset);
+    std::memcpy(data + offset, bytes, first);
+    std::memcpy(data, bytes + first, length - first);
+    tail.store(currentTail + length, std::memory_order_release);
+    return length;
+  }
+
+  size_t read(char *bytes, size_t length) {
+    uint64_t currentHead = head.load(std::memory_order_relaxed);
+    length = std::min<size_t>(length, tail.load(std::memory_order_acquire) - currentHead);
+    size_t offset = currentHead % SHM_RING_SIZE;
+    size_t first = std::min<size_t>(length, SHM_RING_SIZE - offset);
+    std::memcpy(bytes, data + offset, first);
+    std::memcpy(bytes + first, data, length - first);
+    head.store(currentHead + length, std::memory_order_release);
+    return length;
+  }
+
+  bool empty() const { return tail.load(std::memory_order_acquire) == head.load(std::memory_order_relaxed); }
+  bool full() const { return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) == SHM_RING_SIZE; }
+};
+
+/*Memory shared with a local client. A side that finds its ring empty or full raises its flag and sleeps on the local socket,
+  the other side clears the flag and writes a doorbell byte there, so frames cost no syscall while both are busy*/
+struct SharedChannel {
+  SharedRing toServer;
+  SharedRing toClient;
+  std::atomic<uint32_t> serverWaiting{0};
+  std::atomic<uint32_t> clientWaiting{0};
+};
+
+#endif